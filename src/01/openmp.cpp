@@ -1,6 +1,6 @@
 #include <iostream>
 #include <array>
-#include <list>
+#include <atomic>
 #include <thread>
 #include <omp.h>
 
@@ -15,7 +15,10 @@ struct Message
 	data{ nullptr },
 	count{ 0 },
 	typeSize{ 0 },
-	senderId{ ANY_THREAD }
+	bufferClass{ 0 },
+	senderId{ ANY_THREAD },
+	ownerId{ ANY_THREAD },
+	next{ nullptr }
   {}
 
   Message(const Message&) = delete;
@@ -23,93 +26,303 @@ struct Message
   Message(Message&&) = delete;
   Message& operator=(Message&&) = delete;
 
-  ~Message()
-  {
-	reset();
-  }
-
+  /*!
+   * \brief Скопировать данные в буфер сообщения. Буфер выделяется пулом сообщений (MessagePool::acquireMessage).
+   */
   void setData(void* data, int count, int typeSize, int senderId = ANY_THREAD)
   {
-	reset();
 	this->senderId = senderId;
 	this->count = count;
 	this->typeSize = typeSize;
-	this->data = new char[count * typeSize];
 	std::memcpy(this->data, data, count * typeSize);
   }
 
-  void reset()
+  void* data;		  // Указатель на данные
+  size_t count;		  // Количество данных
+  size_t typeSize;	  // Размер типа данных
+  int bufferClass;	  // Класс размера буфера данных в пуле сообщений
+  short int senderId; // ID потока-отправителя
+  short int ownerId;  // ID потока, пулу которого принадлежит сообщение
+  Message* next;	  // Следующее сообщение в очереди
+};
+
+/*!
+ * \brief Пул сообщений потока. Переиспользует заголовки сообщений и буферы данных.
+ *
+ * Буферы разбиты на классы по размеру (степени двойки от 2^MIN_SIZE_CLASS до 2^(SIZE_CLASSES - 1) байт),
+ * буферы большего размера выделяются и освобождаются напрямую. Получатель возвращает сообщение в пул потока-владельца
+ * через lock-free стек возвращенных сообщений, который владелец забирает целиком при следующем выделении.
+ */
+struct MessagePool
+{
+  static const int MIN_SIZE_CLASS = 4;
+  static const int SIZE_CLASSES = 25;
+
+  explicit MessagePool() :
+	freeMessages{ nullptr },
+	freeBuffers{},
+	returned{ nullptr },
+	messageHits{ 0 },
+	messageMisses{ 0 },
+	bufferHits{ 0 },
+	bufferMisses{ 0 }
+  {}
+
+  MessagePool(const MessagePool&) = delete;
+  MessagePool& operator=(const MessagePool&) = delete;
+
+  /*!
+   * \brief Освободить заголовки и буферы, накопленные пулом, в том числе возвращенные получателями.
+   */
+  ~MessagePool()
   {
-	if (data != nullptr)
+	collectReturned();
+
+	while (freeMessages != nullptr)
+	{
+	  Message* next = freeMessages->next;
+	  delete freeMessages;
+	  freeMessages = next;
+	}
+
+	for (char*& buffer : freeBuffers)
 	{
-	  delete[] data;
-	  data = nullptr;
+	  while (buffer != nullptr)
+	  {
+		char* next = *reinterpret_cast<char**>(buffer);
+		delete[] buffer;
+		buffer = next;
+	  }
 	}
-	count = 0;
-	typeSize = 0;
-	senderId = ANY_THREAD;
   }
 
-  void* data;		  // Указатель на данные
-  size_t count;		  // Количество данных
-  size_t typeSize;	  // Размер типа данных
-  short int senderId; // ID потока-отправителя
+  /*!
+   * \brief Выделить сообщение с буфером данных размером не менее size байт. Вызывается только потоком-владельцем.
+   */
+  Message* acquireMessage(int ownerId, size_t size)
+  {
+	if (returned.load(std::memory_order_relaxed) != nullptr)
+	{
+	  collectReturned();
+	}
+
+	Message* message = freeMessages;
+
+	if (message != nullptr)
+	{
+	  freeMessages = message->next;
+	  message->next = nullptr;
+	  ++messageHits;
+	}
+	else
+	{
+	  message = new Message;
+	  ++messageMisses;
+	}
+
+	message->ownerId = ownerId;
+	message->bufferClass = getSizeClass(size);
+	message->data = acquireBuffer(message->bufferClass, size);
+
+	return message;
+  }
+
+  /*!
+   * \brief Вернуть сообщение в пул. Может вызываться любым потоком.
+   */
+  void releaseMessage(Message* message)
+  {
+	message->next = returned.load(std::memory_order_relaxed);
+
+	while (!returned.compare_exchange_weak(message->next, message, std::memory_order_release, std::memory_order_relaxed))
+	{
+	}
+  }
+
+  void* acquireBuffer(int sizeClass, size_t size)
+  {
+	if (sizeClass >= SIZE_CLASSES)
+	{
+	  ++bufferMisses;
+	  return new char[size];
+	}
+
+	char* buffer = freeBuffers[sizeClass];
+
+	if (buffer != nullptr)
+	{
+	  freeBuffers[sizeClass] = *reinterpret_cast<char**>(buffer);
+	  ++bufferHits;
+	  return buffer;
+	}
+
+	++bufferMisses;
+	return new char[static_cast<size_t>(1) << sizeClass];
+  }
+
+  /*!
+   * \brief Перенести возвращенные сообщения и их буферы в списки свободных.
+   */
+  void collectReturned()
+  {
+	Message* message = returned.exchange(nullptr, std::memory_order_acquire);
+
+	while (message != nullptr)
+	{
+	  Message* next = message->next;
+	  char* buffer = static_cast<char*>(message->data);
+
+	  if (message->bufferClass < SIZE_CLASSES)
+	  {
+		*reinterpret_cast<char**>(buffer) = freeBuffers[message->bufferClass];
+		freeBuffers[message->bufferClass] = buffer;
+	  }
+	  else
+	  {
+		delete[] buffer;
+	  }
+
+	  message->data = nullptr;
+	  message->next = freeMessages;
+	  freeMessages = message;
+	  message = next;
+	}
+  }
+
+  static int getSizeClass(size_t size)
+  {
+	int sizeClass = MIN_SIZE_CLASS;
+
+	while ((static_cast<size_t>(1) << sizeClass) < size)
+	{
+	  ++sizeClass;
+	}
+
+	return sizeClass;
+  }
+
+  Message* freeMessages;				// Список свободных заголовков (доступен только потоку-владельцу)
+  char* freeBuffers[SIZE_CLASSES];		// Списки свободных буферов по классам размера
+  std::atomic<Message*> returned;		// Стек сообщений, возвращенных получателями
+  size_t messageHits;					// Заголовки, взятые из пула
+  size_t messageMisses;					// Заголовки, выделенные в куче
+  size_t bufferHits;					// Буферы, взятые из пула
+  size_t bufferMisses;					// Буферы, выделенные в куче
 };
 
 /*!
- * \brief Хранилище сообщений. Хранит сообщения для определенного потока в виде связного списка.
+ * \brief Хранилище сообщений. Хранит сообщения для определенного потока.
+ *
+ * Отправители добавляют сообщения в стек входящих сообщений без блокировок (CAS на вершине стека).
+ * Поток-владелец забирает стек целиком и переносит его в собственную очередь, доступ к которой имеет только он,
+ * поэтому ни отправка, ни поиск сообщения не требуют взятия мьютекса.
  */
 struct ThreadInputStorage
 {
   explicit ThreadInputStorage() :
-	messages{},
-	storageLock{ nullptr }
+	incoming{ nullptr },
+	first{ nullptr },
+	last{ nullptr }
+  {}
+
+  void pushMessage(Message* message)
   {
-	omp_init_lock(&storageLock);
+	message->next = incoming.load(std::memory_order_relaxed);
+
+	while (!incoming.compare_exchange_weak(message->next, message, std::memory_order_release, std::memory_order_relaxed))
+	{
+	}
   }
 
-  ~ThreadInputStorage()
+  Message* popMessage(int senderId = Message::ANY_THREAD)
   {
-	omp_destroy_lock(&storageLock);
+	Message* result = findMessage(senderId);
+
+	if (result == nullptr && incoming.load(std::memory_order_relaxed) != nullptr)
+	{
+	  collectIncoming();
+	  result = findMessage(senderId);
+	}
+
+	return result;
   }
 
-  void pushMessage(Message* message)
+  /*!
+   * \brief Перенести входящие сообщения в очередь потока-владельца, сохраняя порядок их отправки.
+   */
+  void collectIncoming()
   {
-	omp_set_lock(&storageLock);
-	messages.push_back(message);
-	omp_unset_lock(&storageLock);
+	Message* message = incoming.exchange(nullptr, std::memory_order_acquire);
+	Message* tail = message;
+	Message* head = nullptr;
+
+	while (message != nullptr)
+	{
+	  Message* next = message->next;
+	  message->next = head;
+	  head = message;
+	  message = next;
+	}
+
+	if (head == nullptr)
+	{
+	  return;
+	}
+
+	if (last == nullptr)
+	{
+	  first = head;
+	}
+	else
+	{
+	  last->next = head;
+	}
+	last = tail;
   }
 
-  Message* popMessage(int senderId = Message::ANY_THREAD)
+  /*!
+   * \brief Найти и извлечь из очереди потока-владельца первое подходящее сообщение.
+   */
+  Message* findMessage(int senderId)
   {
-	Message* result = nullptr;
+	Message* previous = nullptr;
 
-	omp_set_lock(&storageLock);
-	if (!messages.empty())
+	for (Message* message = first; message != nullptr; previous = message, message = message->next)
 	{
-	  for (auto it = messages.cbegin(); it != messages.cend(); ++it)
+	  if (senderId == Message::ANY_THREAD || senderId == message->senderId)
 	  {
-		if (senderId == Message::ANY_THREAD || senderId == (*it)->senderId)
+		if (previous == nullptr)
 		{
-		  result = *it;
-		  messages.erase(it);
-		  break;
+		  first = message->next;
 		}
+		else
+		{
+		  previous->next = message->next;
+		}
+
+		if (last == message)
+		{
+		  last = previous;
+		}
+
+		message->next = nullptr;
+		return message;
 	  }
 	}
-	omp_unset_lock(&storageLock);
 
-	return result;
+	return nullptr;
   }
 
-  omp_lock_t storageLock;		// Мьютекс на доступ к списку сообщений
-  std::list<Message*> messages;	// Связный список сообщений
+  std::atomic<Message*> incoming;	// Стек входящих сообщений (заполняется отправителями)
+  Message* first;				// Начало очереди сообщений (доступна только потоку-владельцу)
+  Message* last;				// Конец очереди сообщений
 };
 
 namespace
 {
   constexpr int THREADS = 6;
   std::array<ThreadInputStorage, THREADS> INPUT_STORAGES;
+  std::array<MessagePool, THREADS> MESSAGE_POOLS;
 }
 
 /*!
@@ -129,9 +342,10 @@ void sendData(void* data, int count, int typeSize, int destination)
 	return;
   }
 
+  const auto threadId = omp_get_thread_num();
   auto& storage = INPUT_STORAGES.at(destination);
-  auto* message = new Message;
-  message->setData(data, count, typeSize, omp_get_thread_num());
+  auto* message = MESSAGE_POOLS.at(threadId).acquireMessage(threadId, static_cast<size_t>(count) * typeSize);
+  message->setData(data, count, typeSize, threadId);
   storage.pushMessage(message);
 }
 
@@ -163,7 +377,26 @@ Message* recieveData(void* data, int count, int typeSize, int source = Message::
 
   std::memcpy(data, message->data, size);
 
-  delete message;
+  MESSAGE_POOLS.at(message->ownerId).releaseMessage(message);
+}
+
+/*!
+ * \brief Вывести долю заголовков и буферов сообщений, взятых из пулов потоков.
+ */
+void printMessagePoolStatistics()
+{
+  size_t messageHits = 0, messageMisses = 0, bufferHits = 0, bufferMisses = 0;
+
+  for (const auto& pool : MESSAGE_POOLS)
+  {
+	messageHits += pool.messageHits;
+	messageMisses += pool.messageMisses;
+	bufferHits += pool.bufferHits;
+	bufferMisses += pool.bufferMisses;
+  }
+
+  printf("Message pool hit rate: headers %zu/%zu, buffers %zu/%zu\n",
+	messageHits, messageHits + messageMisses, bufferHits, bufferHits + bufferMisses);
 }
 
 void fillArrayWithData(char* data, int count)
@@ -225,5 +458,8 @@ int main()
 	std::this_thread::sleep_for(std::chrono::milliseconds(50));
   }
 
+  printf("\n");
+  printMessagePoolStatistics();
+
   return 0;
 }
@@ -1,6 +1,6 @@
 #include <iostream>
 #include <array>
-#include <list>
+#include <atomic>
 #include <thread>
 #include <omp.h>
 
@@ -15,7 +15,8 @@ struct Message
 	data{ nullptr },
 	count{ 0 },
 	typeSize{ 0 },
-	senderId{ ANY_THREAD }
+	senderId{ ANY_THREAD },
+	next{ nullptr }
   {}
 
   Message(const Message&) = delete;
@@ -54,56 +55,115 @@ struct Message
   size_t count;		  // Количество данных
   size_t typeSize;	  // Размер типа данных
   short int senderId; // ID потока-отправителя
+  Message* next;	  // Следующее сообщение в очереди
 };
 
 /*!
- * \brief Хранилище сообщений. Хранит сообщения для определенного потока в виде связного списка.
+ * \brief Хранилище сообщений. Хранит сообщения для определенного потока.
+ *
+ * Отправители добавляют сообщения в стек входящих сообщений без блокировок (CAS на вершине стека).
+ * Поток-владелец забирает стек целиком и переносит его в собственную очередь, доступ к которой имеет только он,
+ * поэтому ни отправка, ни поиск сообщения не требуют взятия мьютекса.
  */
 struct ThreadInputStorage
 {
   explicit ThreadInputStorage() :
-	messages{},
-	storageLock{ nullptr }
+	incoming{ nullptr },
+	first{ nullptr },
+	last{ nullptr }
+  {}
+
+  void pushMessage(Message* message)
   {
-	omp_init_lock(&storageLock);
+	message->next = incoming.load(std::memory_order_relaxed);
+
+	while (!incoming.compare_exchange_weak(message->next, message, std::memory_order_release, std::memory_order_relaxed))
+	{
+	}
   }
 
-  ~ThreadInputStorage()
+  Message* popMessage(int senderId = Message::ANY_THREAD)
   {
-	omp_destroy_lock(&storageLock);
+	Message* result = findMessage(senderId);
+
+	if (result == nullptr && incoming.load(std::memory_order_relaxed) != nullptr)
+	{
+	  collectIncoming();
+	  result = findMessage(senderId);
+	}
+
+	return result;
   }
 
-  void pushMessage(Message* message)
+  /*!
+   * \brief Перенести входящие сообщения в очередь потока-владельца, сохраняя порядок их отправки.
+   */
+  void collectIncoming()
   {
-	omp_set_lock(&storageLock);
-	messages.push_back(message);
-	omp_unset_lock(&storageLock);
+	Message* message = incoming.exchange(nullptr, std::memory_order_acquire);
+	Message* tail = message;
+	Message* head = nullptr;
+
+	while (message != nullptr)
+	{
+	  Message* next = message->next;
+	  message->next = head;
+	  head = message;
+	  message = next;
+	}
+
+	if (head == nullptr)
+	{
+	  return;
+	}
+
+	if (last == nullptr)
+	{
+	  first = head;
+	}
+	else
+	{
+	  last->next = head;
+	}
+	last = tail;
   }
 
-  Message* popMessage(int senderId = Message::ANY_THREAD)
+  /*!
+   * \brief Найти и извлечь из очереди потока-владельца первое подходящее сообщение.
+   */
+  Message* findMessage(int senderId)
   {
-	Message* result = nullptr;
+	Message* previous = nullptr;
 
-	omp_set_lock(&storageLock);
-	if (!messages.empty())
+	for (Message* message = first; message != nullptr; previous = message, message = message->next)
 	{
-	  for (auto it = messages.cbegin(); it != messages.cend(); ++it)
+	  if (senderId == Message::ANY_THREAD || senderId == message->senderId)
 	  {
-		if (senderId == Message::ANY_THREAD || senderId == (*it)->senderId)
+		if (previous == nullptr)
+		{
+		  first = message->next;
+		}
+		else
+		{
+		  previous->next = message->next;
+		}
+
+		if (last == message)
 		{
-		  result = *it;
-		  messages.erase(it);
-		  break;
+		  last = previous;
 		}
+
+		message->next = nullptr;
+		return message;
 	  }
 	}
-	omp_unset_lock(&storageLock);
 
-	return result;
+	return nullptr;
   }
 
-  omp_lock_t storageLock;		// Мьютекс на доступ к списку сообщений
-  std::list<Message*> messages;	// Связный список сообщений
+  std::atomic<Message*> incoming;	// Стек входящих сообщений (заполняется отправителями)
+  Message* first;				// Начало очереди сообщений (доступна только потоку-владельцу)
+  Message* last;				// Конец очереди сообщений
 };
 
 namespace
@@ -1,7 +1,7 @@
 #include <iostream>
 #include <array>
+#include <atomic>
 #include <functional>
-#include <list>
 #include <thread>
 #include <omp.h>
 
@@ -10,7 +10,54 @@
  */
 enum OperationType
 {
-  SUM = 0
+  SUM = 0,
+  MIN = 1,
+  MAX = 2,
+  PROD = 3
+};
+
+/*!
+ * \brief Алгоритм коллективной операции приведения.
+ *
+ * LINEAR - корневой поток последовательно принимает данные от всех потоков.
+ * BINOMIAL_TREE - приведение по биномиальному дереву за log(P) шагов, на каждом шаге передается весь массив.
+ * RECURSIVE_HALVING - приведение рекурсивным делением массива пополам с последующим сбором частей в корне:
+ * каждый поток передает O(count) данных вместо O(count * log(P)), что выгодно для длинных массивов.
+ * AUTO - BINOMIAL_TREE для коротких массивов и RECURSIVE_HALVING для массивов от REDUCE_HALVING_THRESHOLD байт.
+ */
+enum ReduceAlgorithm
+{
+  AUTO = 0,
+  LINEAR = 1,
+  BINOMIAL_TREE = 2,
+  RECURSIVE_HALVING = 3
+};
+
+/*!
+ * \brief Поэлементные операции приведения. Пользовательская операция должна быть ассоциативной и коммутативной.
+ */
+template<typename T>
+struct SumOperation
+{
+  T operator()(const T& left, const T& right) const { return left + right; }
+};
+
+template<typename T>
+struct MinOperation
+{
+  T operator()(const T& left, const T& right) const { return (right < left) ? right : left; }
+};
+
+template<typename T>
+struct MaxOperation
+{
+  T operator()(const T& left, const T& right) const { return (left < right) ? right : left; }
+};
+
+template<typename T>
+struct ProdOperation
+{
+  T operator()(const T& left, const T& right) const { return left * right; }
 };
 
 /*!
@@ -24,7 +71,8 @@ struct Message
 	data{ nullptr },
 	count{ 0 },
 	typeSize{ 0 },
-	senderId{ ANY_THREAD }
+	senderId{ ANY_THREAD },
+	next{ nullptr }
   {}
 
   Message(const Message&) = delete;
@@ -63,61 +111,121 @@ struct Message
   size_t count;		  // Количество данных
   size_t typeSize;	  // Размер типа данных
   short int senderId; // ID потока-отправителя
+  Message* next;	  // Следующее сообщение в очереди
 };
 
 /*!
- * \brief Хранилище сообщений. Хранит сообщения для определенного потока в виде связного списка.
+ * \brief Хранилище сообщений. Хранит сообщения для определенного потока.
+ *
+ * Отправители добавляют сообщения в стек входящих сообщений без блокировок (CAS на вершине стека).
+ * Поток-владелец забирает стек целиком и переносит его в собственную очередь, доступ к которой имеет только он,
+ * поэтому ни отправка, ни поиск сообщения не требуют взятия мьютекса.
  */
 struct ThreadInputStorage
 {
   explicit ThreadInputStorage() :
-	messages{},
-	storageLock{ nullptr }
+	incoming{ nullptr },
+	first{ nullptr },
+	last{ nullptr }
+  {}
+
+  void pushMessage(Message* message)
   {
-	omp_init_lock(&storageLock);
+	message->next = incoming.load(std::memory_order_relaxed);
+
+	while (!incoming.compare_exchange_weak(message->next, message, std::memory_order_release, std::memory_order_relaxed))
+	{
+	}
   }
 
-  ~ThreadInputStorage()
+  Message* popMessage(int senderId = Message::ANY_THREAD)
   {
-	omp_destroy_lock(&storageLock);
+	Message* result = findMessage(senderId);
+
+	if (result == nullptr && incoming.load(std::memory_order_relaxed) != nullptr)
+	{
+	  collectIncoming();
+	  result = findMessage(senderId);
+	}
+
+	return result;
   }
 
-  void pushMessage(Message* message)
+  /*!
+   * \brief Перенести входящие сообщения в очередь потока-владельца, сохраняя порядок их отправки.
+   */
+  void collectIncoming()
   {
-	omp_set_lock(&storageLock);
-	messages.push_back(message);
-	omp_unset_lock(&storageLock);
+	Message* message = incoming.exchange(nullptr, std::memory_order_acquire);
+	Message* tail = message;
+	Message* head = nullptr;
+
+	while (message != nullptr)
+	{
+	  Message* next = message->next;
+	  message->next = head;
+	  head = message;
+	  message = next;
+	}
+
+	if (head == nullptr)
+	{
+	  return;
+	}
+
+	if (last == nullptr)
+	{
+	  first = head;
+	}
+	else
+	{
+	  last->next = head;
+	}
+	last = tail;
   }
 
-  Message* popMessage(int senderId = Message::ANY_THREAD)
+  /*!
+   * \brief Найти и извлечь из очереди потока-владельца первое подходящее сообщение.
+   */
+  Message* findMessage(int senderId)
   {
-	Message* result = nullptr;
+	Message* previous = nullptr;
 
-	omp_set_lock(&storageLock);
-	if (!messages.empty())
+	for (Message* message = first; message != nullptr; previous = message, message = message->next)
 	{
-	  for (auto it = messages.cbegin(); it != messages.cend(); ++it)
+	  if (senderId == Message::ANY_THREAD || senderId == message->senderId)
 	  {
-		if (senderId == Message::ANY_THREAD || senderId == (*it)->senderId)
+		if (previous == nullptr)
+		{
+		  first = message->next;
+		}
+		else
 		{
-		  result = *it;
-		  messages.erase(it);
-		  break;
+		  previous->next = message->next;
 		}
+
+		if (last == message)
+		{
+		  last = previous;
+		}
+
+		message->next = nullptr;
+		return message;
 	  }
 	}
-	omp_unset_lock(&storageLock);
 
-	return result;
+	return nullptr;
   }
 
-  omp_lock_t storageLock;		// Мьютекс на доступ к списку сообщений
-  std::list<Message*> messages;	// Связный список сообщений
+  std::atomic<Message*> incoming;	// Стек входящих сообщений (заполняется отправителями)
+  Message* first;				// Начало очереди сообщений (доступна только потоку-владельцу)
+  Message* last;				// Конец очереди сообщений
 };
 
 namespace
 {
   constexpr int THREADS = 1;
+  constexpr size_t REDUCE_HALVING_THRESHOLD = 16 * 1024; // Размер массива в байтах, начиная с которого AUTO выбирает RECURSIVE_HALVING
   std::array<ThreadInputStorage, THREADS> INPUT_STORAGES;
 }
 
@@ -175,6 +283,151 @@ void recieveData(void* data, int count, int typeSize, int source = Message::ANY_
   delete message;
 }
 
+/*!
+ * \brief Применить операцию к массивам поэлементно: result[i] = operation(result[i], values[i]).
+ *
+ * Операция подставляется на этапе компиляции, поэтому цикл не содержит ветвлений и векторизуется.
+ */
+template<typename T, typename Operation>
+void combineData(T* __restrict result, const T* __restrict values, int count, Operation operation)
+{
+  #pragma omp simd
+  for (int i = 0; i < count; ++i)
+  {
+	result[i] = operation(result[i], values[i]);
+  }
+}
+
+/*!
+ * \brief Приведение с последовательным приемом данных корневым потоком.
+ */
+template<typename T, typename Operation>
+void reduceLinear(T* buffer, T* tempBuffer, int count, int root, Operation operation)
+{
+  if (omp_get_thread_num() != root)
+  {
+	sendData(buffer, count, sizeof(T), root);
+	return;
+  }
+
+  for (int i = 0; i < THREADS; ++i)
+  {
+	if (i == root)
+	  continue;
+
+	recieveData(tempBuffer, count, sizeof(T), i);
+	combineData(buffer, tempBuffer, count, operation);
+  }
+}
+
+/*!
+ * \brief Приведение по биномиальному дереву с корнем root.
+ */
+template<typename T, typename Operation>
+void reduceBinomialTree(T* buffer, T* tempBuffer, int count, int root, Operation operation)
+{
+  const int rank = (omp_get_thread_num() - root + THREADS) % THREADS;
+
+  for (int mask = 1; mask < THREADS; mask <<= 1)
+  {
+	if (rank & mask)
+	{
+	  sendData(buffer, count, sizeof(T), (rank - mask + root) % THREADS);
+	  return;
+	}
+
+	if (rank + mask < THREADS)
+	{
+	  recieveData(tempBuffer, count, sizeof(T), (rank + mask + root) % THREADS);
+	  combineData(buffer, tempBuffer, count, operation);
+	}
+  }
+}
+
+/*!
+ * \brief Приведение рекурсивным делением пополам (reduce-scatter) со сбором частей в корне по биномиальному дереву.
+ *
+ * Если число потоков не является степенью двойки, первые 2 * remainder потоков предварительно объединяются в пары.
+ */
+template<typename T, typename Operation>
+void reduceRecursiveHalving(T* buffer, T* tempBuffer, int count, int root, Operation operation)
+{
+  const int rank = (omp_get_thread_num() - root + THREADS) % THREADS;
+
+  int powerOfTwo = 1;
+  while (powerOfTwo * 2 <= THREADS)
+  {
+	powerOfTwo *= 2;
+  }
+
+  const int remainder = THREADS - powerOfTwo;
+
+  if (rank < 2 * remainder)
+  {
+	if (rank % 2 == 1)
+	{
+	  sendData(buffer, count, sizeof(T), (rank - 1 + root) % THREADS);
+	  return;
+	}
+
+	recieveData(tempBuffer, count, sizeof(T), (rank + 1 + root) % THREADS);
+	combineData(buffer, tempBuffer, count, operation);
+  }
+
+  const int newRank = (rank < 2 * remainder) ? rank / 2 : rank - remainder;
+
+  const auto getThreadId = [root, remainder](int newRank)
+  {
+	const int rank = (newRank < remainder) ? newRank * 2 : newRank + remainder;
+	return (rank + root) % THREADS;
+  };
+
+  // Смещение начала части массива с индексом block (массив разбит на powerOfTwo почти равных частей)
+  const auto getOffset = [count, powerOfTwo](int block)
+  {
+	const int extra = count % powerOfTwo;
+	return block * (count / powerOfTwo) + ((block < extra) ? block : extra);
+  };
+
+  int low = 0;
+  int high = powerOfTwo;
+
+  for (int mask = powerOfTwo / 2; mask > 0; mask >>= 1)
+  {
+	const int partner = getThreadId(newRank ^ mask);
+	const int middle = (low + high) / 2;
+	int sendLow = middle;
+	int sendHigh = high;
+
+	if (newRank & mask)
+	{
+	  sendLow = low;
+	  sendHigh = middle;
+	  low = middle;
+	}
+	else
+	{
+	  high = middle;
+	}
+
+	sendData(buffer + getOffset(sendLow), getOffset(sendHigh) - getOffset(sendLow), sizeof(T), partner);
+	recieveData(tempBuffer, getOffset(high) - getOffset(low), sizeof(T), partner);
+	combineData(buffer + getOffset(low), tempBuffer, getOffset(high) - getOffset(low), operation);
+  }
+
+  for (int mask = 1; mask < powerOfTwo; mask <<= 1)
+  {
+	if (newRank & mask)
+	{
+	  sendData(buffer + getOffset(low), getOffset(high) - getOffset(low), sizeof(T), getThreadId(newRank - mask));
+	  return;
+	}
+
+	recieveData(buffer + getOffset(high), getOffset(high + mask) - getOffset(high), sizeof(T), getThreadId(newRank + mask));
+	high += mask;
+  }
+}
+
 /*!
  * \brief Функция коллективного приема сообщений от других потоков и выполнения операций над данными.
  *
@@ -184,40 +437,66 @@ void recieveData(void* data, int count, int typeSize, int source = Message::ANY_
  * \param recvBuffer Указатель на массив данных, куда необходимо записать полученные данные
  * \param count Количество элементов в массиве данных
  * \param root ID потока, который принимает данные
- * \param operation Операция, осуществляемая над данными
+ * \param operation Операция, осуществляемая над данными (функциональный объект, например SumOperation<T>)
+ * \param algorithm Алгоритм приведения
  */
-template<typename T>
-Message* reduceData(void* sendBuffer, void* recvBuffer, int count, int root, const OperationType operation)
+template<typename T, typename Operation>
+void reduceData(void* sendBuffer, void* recvBuffer, int count, int root, Operation operation, ReduceAlgorithm algorithm = ReduceAlgorithm::AUTO)
 {
   const auto threadId = omp_get_thread_num();
-  if (root == threadId)
-  {
-	T* resultBuffer = reinterpret_cast<T*>(recvBuffer);
-	T* tempBuffer = new T[count];
+  T* buffer = (threadId == root) ? static_cast<T*>(recvBuffer) : new T[count];
+  T* tempBuffer = new T[count];
 
-	std::memcpy(recvBuffer, sendBuffer, count * sizeof(T));
+  std::memcpy(buffer, sendBuffer, count * sizeof(T));
 
-	for (int i = 0; i < THREADS; ++i)
-	{
-	  if (i == root)
-		continue;
+  if (algorithm == ReduceAlgorithm::AUTO)
+  {
+	algorithm = (count * sizeof(T) >= REDUCE_HALVING_THRESHOLD) ? ReduceAlgorithm::RECURSIVE_HALVING : ReduceAlgorithm::BINOMIAL_TREE;
+  }
 
-	  recieveData(tempBuffer, count, sizeof(T), i);
+  switch (algorithm)
+  {
+  case ReduceAlgorithm::LINEAR:
+	reduceLinear(buffer, tempBuffer, count, root, operation);
+	break;
+  case ReduceAlgorithm::RECURSIVE_HALVING:
+	reduceRecursiveHalving(buffer, tempBuffer, count, root, operation);
+	break;
+  default:
+	reduceBinomialTree(buffer, tempBuffer, count, root, operation);
+	break;
+  }
 
-	  for (int j = 0; j < count; ++j)
-	  {
-		if (operation == OperationType::SUM)
-		{
-		  resultBuffer[j] += tempBuffer[j];
-		}
-	  }
-	}
+  delete[] tempBuffer;
 
-	delete[] tempBuffer;
+  if (threadId != root)
+  {
+	delete[] buffer;
   }
-  else
+}
+
+/*!
+ * \brief Функция коллективного приема сообщений от других потоков и выполнения стандартной операции над данными.
+ *
+ * Операция выбирается один раз, после чего вызывается специализированная версия reduceData.
+ */
+template<typename T>
+void reduceData(void* sendBuffer, void* recvBuffer, int count, int root, const OperationType operation, ReduceAlgorithm algorithm = ReduceAlgorithm::AUTO)
+{
+  switch (operation)
   {
-	sendData(sendBuffer, count, sizeof(T), root);
+  case OperationType::MIN:
+	reduceData<T>(sendBuffer, recvBuffer, count, root, MinOperation<T>{}, algorithm);
+	break;
+  case OperationType::MAX:
+	reduceData<T>(sendBuffer, recvBuffer, count, root, MaxOperation<T>{}, algorithm);
+	break;
+  case OperationType::PROD:
+	reduceData<T>(sendBuffer, recvBuffer, count, root, ProdOperation<T>{}, algorithm);
+	break;
+  default:
+	reduceData<T>(sendBuffer, recvBuffer, count, root, SumOperation<T>{}, algorithm);
+	break;
   }
 }
 
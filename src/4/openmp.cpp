@@ -1,8 +1,10 @@
 #include <iostream>
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <functional>
-#include <list>
 #include <set>
+#include <vector>
 #include <thread>
 #include <omp.h>
 
@@ -11,7 +13,62 @@
  */
 enum OperationType
 {
-  SUM = 0
+  SUM = 0,
+  MIN = 1,
+  MAX = 2,
+  PROD = 3
+};
+
+/*!
+ * \brief Алгоритм коллективной операции приведения.
+ *
+ * LINEAR - корневой поток последовательно принимает данные от всех потоков.
+ * BINOMIAL_TREE - приведение по биномиальному дереву за log(P) шагов, на каждом шаге передается весь массив.
+ * RECURSIVE_HALVING - приведение рекурсивным делением массива пополам с последующим сбором частей в корне:
+ * каждый поток передает O(count) данных вместо O(count * log(P)), что выгодно для длинных массивов.
+ * AUTO - BINOMIAL_TREE для коротких массивов и RECURSIVE_HALVING для массивов от REDUCE_HALVING_THRESHOLD байт.
+ *
+ * Для allReduceData:
+ * LINEAR - каждый поток коммутатора отправляет весь массив всем остальным потокам (O(P^2) сообщений).
+ * RECURSIVE_DOUBLING - обмен всем массивом с партнером на расстоянии 1, 2, 4, ... за log(P) шагов.
+ * RING - кольцевой reduce-scatter и allgather: каждый поток передает 2 * count * (P - 1) / P элементов.
+ * AUTO - RECURSIVE_DOUBLING для коротких массивов и малых групп, RING для массивов от ALLREDUCE_RING_THRESHOLD байт.
+ */
+enum ReduceAlgorithm
+{
+  AUTO = 0,
+  LINEAR = 1,
+  BINOMIAL_TREE = 2,
+  RECURSIVE_HALVING = 3,
+  RECURSIVE_DOUBLING = 4,
+  RING = 5
+};
+
+/*!
+ * \brief Поэлементные операции приведения. Пользовательская операция должна быть ассоциативной и коммутативной.
+ */
+template<typename T>
+struct SumOperation
+{
+  T operator()(const T& left, const T& right) const { return left + right; }
+};
+
+template<typename T>
+struct MinOperation
+{
+  T operator()(const T& left, const T& right) const { return (right < left) ? right : left; }
+};
+
+template<typename T>
+struct MaxOperation
+{
+  T operator()(const T& left, const T& right) const { return (left < right) ? right : left; }
+};
+
+template<typename T>
+struct ProdOperation
+{
+  T operator()(const T& left, const T& right) const { return left * right; }
 };
 
 /*!
@@ -25,7 +82,8 @@ struct Message
 	data{ nullptr },
 	count{ 0 },
 	typeSize{ 0 },
-	senderId{ ANY_THREAD }
+	senderId{ ANY_THREAD },
+	next{ nullptr }
   {}
 
   Message(const Message&) = delete;
@@ -64,56 +122,115 @@ struct Message
   size_t count;		  // Количество данных
   size_t typeSize;	  // Размер типа данных
   short int senderId; // ID потока-отправителя
+  Message* next;	  // Следующее сообщение в очереди
 };
 
 /*!
- * \brief Хранилище сообщений. Хранит сообщения для определенного потока в виде связного списка.
+ * \brief Хранилище сообщений. Хранит сообщения для определенного потока.
+ *
+ * Отправители добавляют сообщения в стек входящих сообщений без блокировок (CAS на вершине стека).
+ * Поток-владелец забирает стек целиком и переносит его в собственную очередь, доступ к которой имеет только он,
+ * поэтому ни отправка, ни поиск сообщения не требуют взятия мьютекса.
  */
 struct ThreadInputStorage
 {
   explicit ThreadInputStorage() :
-	messages{},
-	storageLock{ nullptr }
+	incoming{ nullptr },
+	first{ nullptr },
+	last{ nullptr }
+  {}
+
+  void pushMessage(Message* message)
   {
-	omp_init_lock(&storageLock);
+	message->next = incoming.load(std::memory_order_relaxed);
+
+	while (!incoming.compare_exchange_weak(message->next, message, std::memory_order_release, std::memory_order_relaxed))
+	{
+	}
   }
 
-  ~ThreadInputStorage()
+  Message* popMessage(int senderId = Message::ANY_THREAD)
   {
-	omp_destroy_lock(&storageLock);
+	Message* result = findMessage(senderId);
+
+	if (result == nullptr && incoming.load(std::memory_order_relaxed) != nullptr)
+	{
+	  collectIncoming();
+	  result = findMessage(senderId);
+	}
+
+	return result;
   }
 
-  void pushMessage(Message* message)
+  /*!
+   * \brief Перенести входящие сообщения в очередь потока-владельца, сохраняя порядок их отправки.
+   */
+  void collectIncoming()
   {
-	omp_set_lock(&storageLock);
-	messages.push_back(message);
-	omp_unset_lock(&storageLock);
+	Message* message = incoming.exchange(nullptr, std::memory_order_acquire);
+	Message* tail = message;
+	Message* head = nullptr;
+
+	while (message != nullptr)
+	{
+	  Message* next = message->next;
+	  message->next = head;
+	  head = message;
+	  message = next;
+	}
+
+	if (head == nullptr)
+	{
+	  return;
+	}
+
+	if (last == nullptr)
+	{
+	  first = head;
+	}
+	else
+	{
+	  last->next = head;
+	}
+	last = tail;
   }
 
-  Message* popMessage(int senderId = Message::ANY_THREAD)
+  /*!
+   * \brief Найти и извлечь из очереди потока-владельца первое подходящее сообщение.
+   */
+  Message* findMessage(int senderId)
   {
-	Message* result = nullptr;
+	Message* previous = nullptr;
 
-	omp_set_lock(&storageLock);
-	if (!messages.empty())
+	for (Message* message = first; message != nullptr; previous = message, message = message->next)
 	{
-	  for (auto it = messages.cbegin(); it != messages.cend(); ++it)
+	  if (senderId == Message::ANY_THREAD || senderId == message->senderId)
 	  {
-		if (senderId == Message::ANY_THREAD || senderId == (*it)->senderId)
+		if (previous == nullptr)
 		{
-		  result = *it;
-		  messages.erase(it);
-		  break;
+		  first = message->next;
 		}
+		else
+		{
+		  previous->next = message->next;
+		}
+
+		if (last == message)
+		{
+		  last = previous;
+		}
+
+		message->next = nullptr;
+		return message;
 	  }
 	}
-	omp_unset_lock(&storageLock);
 
-	return result;
+	return nullptr;
   }
 
-  std::list<Message*> messages;	// Связный список сообщений
-  omp_lock_t storageLock;		// Мьютекс на доступ к списку сообщений
+  std::atomic<Message*> incoming;	// Стек входящих сообщений (заполняется отправителями)
+  Message* first;				// Начало очереди сообщений (доступна только потоку-владельцу)
+  Message* last;				// Конец очереди сообщений
 };
 
 struct Commutator
@@ -144,6 +261,8 @@ struct Commutator
 namespace
 {
   constexpr int THREADS = 20;
+  constexpr size_t REDUCE_HALVING_THRESHOLD = 16 * 1024; // Размер массива в байтах, начиная с которого AUTO выбирает RECURSIVE_HALVING
+  constexpr size_t ALLREDUCE_RING_THRESHOLD = 64 * 1024; // Размер массива в байтах, начиная с которого AUTO выбирает RING
   int THREAD_GROUP_SIZE = 0;
   std::array<ThreadInputStorage, THREADS> INPUT_STORAGES;
 }
@@ -202,6 +321,151 @@ void recieveData(void* data, int count, int typeSize, int source = Message::ANY_
   delete message;
 }
 
+/*!
+ * \brief Применить операцию к массивам поэлементно: result[i] = operation(result[i], values[i]).
+ *
+ * Операция подставляется на этапе компиляции, поэтому цикл не содержит ветвлений и векторизуется.
+ */
+template<typename T, typename Operation>
+void combineData(T* __restrict result, const T* __restrict values, int count, Operation operation)
+{
+  #pragma omp simd
+  for (int i = 0; i < count; ++i)
+  {
+	result[i] = operation(result[i], values[i]);
+  }
+}
+
+/*!
+ * \brief Приведение с последовательным приемом данных корневым потоком.
+ */
+template<typename T, typename Operation>
+void reduceLinear(T* buffer, T* tempBuffer, int count, int root, Operation operation)
+{
+  if (omp_get_thread_num() != root)
+  {
+	sendData(buffer, count, sizeof(T), root);
+	return;
+  }
+
+  for (int i = 0; i < THREADS; ++i)
+  {
+	if (i == root)
+	  continue;
+
+	recieveData(tempBuffer, count, sizeof(T), i);
+	combineData(buffer, tempBuffer, count, operation);
+  }
+}
+
+/*!
+ * \brief Приведение по биномиальному дереву с корнем root.
+ */
+template<typename T, typename Operation>
+void reduceBinomialTree(T* buffer, T* tempBuffer, int count, int root, Operation operation)
+{
+  const int rank = (omp_get_thread_num() - root + THREADS) % THREADS;
+
+  for (int mask = 1; mask < THREADS; mask <<= 1)
+  {
+	if (rank & mask)
+	{
+	  sendData(buffer, count, sizeof(T), (rank - mask + root) % THREADS);
+	  return;
+	}
+
+	if (rank + mask < THREADS)
+	{
+	  recieveData(tempBuffer, count, sizeof(T), (rank + mask + root) % THREADS);
+	  combineData(buffer, tempBuffer, count, operation);
+	}
+  }
+}
+
+/*!
+ * \brief Приведение рекурсивным делением пополам (reduce-scatter) со сбором частей в корне по биномиальному дереву.
+ *
+ * Если число потоков не является степенью двойки, первые 2 * remainder потоков предварительно объединяются в пары.
+ */
+template<typename T, typename Operation>
+void reduceRecursiveHalving(T* buffer, T* tempBuffer, int count, int root, Operation operation)
+{
+  const int rank = (omp_get_thread_num() - root + THREADS) % THREADS;
+
+  int powerOfTwo = 1;
+  while (powerOfTwo * 2 <= THREADS)
+  {
+	powerOfTwo *= 2;
+  }
+
+  const int remainder = THREADS - powerOfTwo;
+
+  if (rank < 2 * remainder)
+  {
+	if (rank % 2 == 1)
+	{
+	  sendData(buffer, count, sizeof(T), (rank - 1 + root) % THREADS);
+	  return;
+	}
+
+	recieveData(tempBuffer, count, sizeof(T), (rank + 1 + root) % THREADS);
+	combineData(buffer, tempBuffer, count, operation);
+  }
+
+  const int newRank = (rank < 2 * remainder) ? rank / 2 : rank - remainder;
+
+  const auto getThreadId = [root, remainder](int newRank)
+  {
+	const int rank = (newRank < remainder) ? newRank * 2 : newRank + remainder;
+	return (rank + root) % THREADS;
+  };
+
+  // Смещение начала части массива с индексом block (массив разбит на powerOfTwo почти равных частей)
+  const auto getOffset = [count, powerOfTwo](int block)
+  {
+	const int extra = count % powerOfTwo;
+	return block * (count / powerOfTwo) + ((block < extra) ? block : extra);
+  };
+
+  int low = 0;
+  int high = powerOfTwo;
+
+  for (int mask = powerOfTwo / 2; mask > 0; mask >>= 1)
+  {
+	const int partner = getThreadId(newRank ^ mask);
+	const int middle = (low + high) / 2;
+	int sendLow = middle;
+	int sendHigh = high;
+
+	if (newRank & mask)
+	{
+	  sendLow = low;
+	  sendHigh = middle;
+	  low = middle;
+	}
+	else
+	{
+	  high = middle;
+	}
+
+	sendData(buffer + getOffset(sendLow), getOffset(sendHigh) - getOffset(sendLow), sizeof(T), partner);
+	recieveData(tempBuffer, getOffset(high) - getOffset(low), sizeof(T), partner);
+	combineData(buffer + getOffset(low), tempBuffer, getOffset(high) - getOffset(low), operation);
+  }
+
+  for (int mask = 1; mask < powerOfTwo; mask <<= 1)
+  {
+	if (newRank & mask)
+	{
+	  sendData(buffer + getOffset(low), getOffset(high) - getOffset(low), sizeof(T), getThreadId(newRank - mask));
+	  return;
+	}
+
+	recieveData(buffer + getOffset(high), getOffset(high + mask) - getOffset(high), sizeof(T), getThreadId(newRank + mask));
+	high += mask;
+  }
+}
+
 /*!
  * \brief Функция коллективного приема сообщений от других потоков и выполнения операций над данными.
  *
@@ -211,40 +475,189 @@ void recieveData(void* data, int count, int typeSize, int source = Message::ANY_
  * \param recvBuffer Указатель на массив данных, куда необходимо записать полученные данные
  * \param count Количество элементов в массиве данных
  * \param root ID потока, который принимает данные
- * \param operation Операция, осуществляемая над данными
+ * \param operation Операция, осуществляемая над данными (функциональный объект, например SumOperation<T>)
+ * \param algorithm Алгоритм приведения
  */
-template<typename T>
-Message* reduceData(void* sendBuffer, void* recvBuffer, int count, int root, const OperationType operation)
+template<typename T, typename Operation>
+void reduceData(void* sendBuffer, void* recvBuffer, int count, int root, Operation operation, ReduceAlgorithm algorithm = ReduceAlgorithm::AUTO)
 {
   const auto threadId = omp_get_thread_num();
-  if (root == threadId)
+  T* buffer = (threadId == root) ? static_cast<T*>(recvBuffer) : new T[count];
+  T* tempBuffer = new T[count];
+
+  std::memcpy(buffer, sendBuffer, count * sizeof(T));
+
+  if (algorithm == ReduceAlgorithm::AUTO)
   {
-	T* resultBuffer = reinterpret_cast<T*>(recvBuffer);
-	T* tempBuffer = new T[count];
+	algorithm = (count * sizeof(T) >= REDUCE_HALVING_THRESHOLD) ? ReduceAlgorithm::RECURSIVE_HALVING : ReduceAlgorithm::BINOMIAL_TREE;
+  }
 
-	std::memcpy(recvBuffer, sendBuffer, count * sizeof(T));
+  switch (algorithm)
+  {
+  case ReduceAlgorithm::LINEAR:
+	reduceLinear(buffer, tempBuffer, count, root, operation);
+	break;
+  case ReduceAlgorithm::RECURSIVE_HALVING:
+	reduceRecursiveHalving(buffer, tempBuffer, count, root, operation);
+	break;
+  default:
+	reduceBinomialTree(buffer, tempBuffer, count, root, operation);
+	break;
+  }
 
-	for (int i = 0; i < THREADS; ++i)
+  delete[] tempBuffer;
+
+  if (threadId != root)
+  {
+	delete[] buffer;
+  }
+}
+
+/*!
+ * \brief Функция коллективного приема сообщений от других потоков и выполнения стандартной операции над данными.
+ *
+ * Операция выбирается один раз, после чего вызывается специализированная версия reduceData.
+ */
+template<typename T>
+void reduceData(void* sendBuffer, void* recvBuffer, int count, int root, const OperationType operation, ReduceAlgorithm algorithm = ReduceAlgorithm::AUTO)
+{
+  switch (operation)
+  {
+  case OperationType::MIN:
+	reduceData<T>(sendBuffer, recvBuffer, count, root, MinOperation<T>{}, algorithm);
+	break;
+  case OperationType::MAX:
+	reduceData<T>(sendBuffer, recvBuffer, count, root, MaxOperation<T>{}, algorithm);
+	break;
+  case OperationType::PROD:
+	reduceData<T>(sendBuffer, recvBuffer, count, root, ProdOperation<T>{}, algorithm);
+	break;
+  default:
+	reduceData<T>(sendBuffer, recvBuffer, count, root, SumOperation<T>{}, algorithm);
+	break;
+  }
+}
+
+/*!
+ * \brief Смещение начала части массива с индексом block при разбиении count элементов на parts почти равных частей.
+ */
+inline int getPartOffset(int count, int parts, int block)
+{
+  const int extra = count % parts;
+  return block * (count / parts) + ((block < extra) ? block : extra);
+}
+
+/*!
+ * \brief Приведение для всех потоков группы: каждый поток отправляет весь массив всем остальным.
+ */
+template<typename T, typename Operation>
+void allReduceLinear(T* buffer, T* tempBuffer, int count, Operation operation, const std::vector<int>& members, int rank)
+{
+  const int size = static_cast<int>(members.size());
+
+  for (int i = 0; i < size; ++i)
+  {
+	if (i != rank)
 	{
-	  if (i == root)
-		continue;
+	  sendData(buffer, count, sizeof(T), members[i]);
+	}
+  }
 
-	  recieveData(tempBuffer, count, sizeof(T), i);
+  for (int i = 0; i < size; ++i)
+  {
+	if (i != rank)
+	{
+	  recieveData(tempBuffer, count, sizeof(T), members[i]);
+	  combineData(buffer, tempBuffer, count, operation);
+	}
+  }
+}
 
-	  for (int j = 0; j < count; ++j)
-	  {
-		if (operation == OperationType::SUM)
-		{
-		  resultBuffer[j] += tempBuffer[j];
-		}
-	  }
+/*!
+ * \brief Приведение для всех потоков группы рекурсивным удвоением.
+ *
+ * Если размер группы не является степенью двойки, первые 2 * remainder потоков предварительно объединяются в пары,
+ * а по окончании обмена результат пересылается выбывшим потокам.
+ */
+template<typename T, typename Operation>
+void allReduceRecursiveDoubling(T* buffer, T* tempBuffer, int count, Operation operation, const std::vector<int>& members, int rank)
+{
+  const int size = static_cast<int>(members.size());
+
+  int powerOfTwo = 1;
+  while (powerOfTwo * 2 <= size)
+  {
+	powerOfTwo *= 2;
+  }
+
+  const int remainder = size - powerOfTwo;
+
+  if (rank < 2 * remainder)
+  {
+	if (rank % 2 == 1)
+	{
+	  sendData(buffer, count, sizeof(T), members[rank - 1]);
+	  recieveData(buffer, count, sizeof(T), members[rank - 1]);
+	  return;
 	}
 
-	delete[] tempBuffer;
+	recieveData(tempBuffer, count, sizeof(T), members[rank + 1]);
+	combineData(buffer, tempBuffer, count, operation);
+  }
+
+  const int newRank = (rank < 2 * remainder) ? rank / 2 : rank - remainder;
+
+  for (int mask = 1; mask < powerOfTwo; mask <<= 1)
+  {
+	const int partnerRank = newRank ^ mask;
+	const int partner = members[(partnerRank < remainder) ? partnerRank * 2 : partnerRank + remainder];
+
+	sendData(buffer, count, sizeof(T), partner);
+	recieveData(tempBuffer, count, sizeof(T), partner);
+	combineData(buffer, tempBuffer, count, operation);
+  }
+
+  if (rank < 2 * remainder)
+  {
+	sendData(buffer, count, sizeof(T), members[rank + 1]);
+  }
+}
+
+/*!
+ * \brief Приведение для всех потоков группы по кольцу: reduce-scatter, затем allgather.
+ *
+ * Массив разбивается на P частей. За P - 1 шагов каждый поток накапливает результат для одной части,
+ * передавая соседу справа по одной части, а затем за P - 1 шагов рассылает готовые части по кольцу.
+ */
+template<typename T, typename Operation>
+void allReduceRing(T* buffer, T* tempBuffer, int count, Operation operation, const std::vector<int>& members, int rank)
+{
+  const int size = static_cast<int>(members.size());
+  const int right = members[(rank + 1) % size];
+  const int left = members[(rank - 1 + size) % size];
+
+  for (int step = 0; step < size - 1; ++step)
+  {
+	const int sendPart = (rank - step + size) % size;
+	const int recvPart = (rank - step - 1 + size) % size;
+	const int sendOffset = getPartOffset(count, size, sendPart);
+	const int recvOffset = getPartOffset(count, size, recvPart);
+	const int recvCount = getPartOffset(count, size, recvPart + 1) - recvOffset;
+
+	sendData(buffer + sendOffset, getPartOffset(count, size, sendPart + 1) - sendOffset, sizeof(T), right);
+	recieveData(tempBuffer, recvCount, sizeof(T), left);
+	combineData(buffer + recvOffset, tempBuffer, recvCount, operation);
   }
-  else
+
+  for (int step = 0; step < size - 1; ++step)
   {
-	sendData(sendBuffer, count, sizeof(T), root);
+	const int sendPart = (rank + 1 - step + size) % size;
+	const int recvPart = (rank - step + size) % size;
+	const int sendOffset = getPartOffset(count, size, sendPart);
+	const int recvOffset = getPartOffset(count, size, recvPart);
+
+	sendData(buffer + sendOffset, getPartOffset(count, size, sendPart + 1) - sendOffset, sizeof(T), right);
+	recieveData(buffer + recvOffset, getPartOffset(count, size, recvPart + 1) - recvOffset, sizeof(T), left);
   }
 }
 
@@ -252,43 +665,77 @@ Message* reduceData(void* sendBuffer, void* recvBuffer, int count, int root, con
  * \brief Функция коллективного приема сообщений всеми потоками коммутатора и выполнения операций над данными.
  *
  * Функция является блокирующей - освобождается после того, как сообщение будет отправлено всеми процессами, после чего все сообщения будут получены и над ними будет выполнена операция.
+ * Для целочисленных типов результат не зависит от выбранного алгоритма.
  *
  * \param sendBuffer Указатель на массив данных, которые нужно отправить
  * \param recvBuffer Указатель на массив данных, куда необходимо записать полученные данные
  * \param count Количество элементов в массиве данных
- * \param operation Операция, осуществляемая над данными
+ * \param operation Операция, осуществляемая над данными (функциональный объект, например SumOperation<T>)
  * \param commutator Коммутатор, процессы которого должны обмениваться сообщениями
+ * \param algorithm Алгоритм приведения (LINEAR, RECURSIVE_DOUBLING, RING или AUTO)
  */
-template<typename T>
-Message* allReduceData(void* sendBuffer, void* recvBuffer, int count, const OperationType operation, const Commutator& commutator)
+template<typename T, typename Operation>
+void allReduceData(void* sendBuffer, void* recvBuffer, int count, Operation operation, const Commutator& commutator, ReduceAlgorithm algorithm = ReduceAlgorithm::AUTO)
 {
-  const auto threads = commutator.threads;
-  for (const auto& thread : threads)
+  const std::vector<int> members(commutator.threads.begin(), commutator.threads.end());
+  const auto member = std::find(members.begin(), members.end(), omp_get_thread_num());
+
+  if (member == members.end())
   {
-	sendData(sendBuffer, count, sizeof(T), thread);
+	return;
   }
 
-  std::memset(recvBuffer, 0, count * sizeof(T));
-
-  T* resultBuffer = reinterpret_cast<T*>(recvBuffer);
+  const int rank = static_cast<int>(member - members.begin());
+  const int size = static_cast<int>(members.size());
+  T* buffer = static_cast<T*>(recvBuffer);
   T* tempBuffer = new T[count];
 
-  for (const auto& thread : threads)
+  std::memcpy(buffer, sendBuffer, count * sizeof(T));
+
+  if (algorithm == ReduceAlgorithm::AUTO)
   {
-	recieveData(tempBuffer, count, sizeof(T), thread);
+	algorithm = (size > 2 && count >= size && count * sizeof(T) >= ALLREDUCE_RING_THRESHOLD) ? ReduceAlgorithm::RING : ReduceAlgorithm::RECURSIVE_DOUBLING;
+  }
 
-	for (int j = 0; j < count; ++j)
-	{
-	  if (operation == OperationType::SUM)
-	  {
-		resultBuffer[j] += tempBuffer[j];
-	  }
-	}
+  switch (algorithm)
+  {
+  case ReduceAlgorithm::LINEAR:
+	allReduceLinear(buffer, tempBuffer, count, operation, members, rank);
+	break;
+  case ReduceAlgorithm::RING:
+	allReduceRing(buffer, tempBuffer, count, operation, members, rank);
+	break;
+  default:
+	allReduceRecursiveDoubling(buffer, tempBuffer, count, operation, members, rank);
+	break;
   }
 
   delete[] tempBuffer;
 }
 
+/*!
+ * \brief Функция коллективного приема сообщений всеми потоками коммутатора и выполнения стандартной операции над данными.
+ */
+template<typename T>
+void allReduceData(void* sendBuffer, void* recvBuffer, int count, const OperationType operation, const Commutator& commutator, ReduceAlgorithm algorithm = ReduceAlgorithm::AUTO)
+{
+  switch (operation)
+  {
+  case OperationType::MIN:
+	allReduceData<T>(sendBuffer, recvBuffer, count, MinOperation<T>{}, commutator, algorithm);
+	break;
+  case OperationType::MAX:
+	allReduceData<T>(sendBuffer, recvBuffer, count, MaxOperation<T>{}, commutator, algorithm);
+	break;
+  case OperationType::PROD:
+	allReduceData<T>(sendBuffer, recvBuffer, count, ProdOperation<T>{}, commutator, algorithm);
+	break;
+  default:
+	allReduceData<T>(sendBuffer, recvBuffer, count, SumOperation<T>{}, commutator, algorithm);
+	break;
+  }
+}
+
 int main1()
 {
   double maxTime = 0.0;
@@ -0,0 +1,928 @@
+#include <iostream>
+#include <functional>
+#include <array>
+#include <atomic>
+#include <vector>
+#include <iterator>
+#include <set>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <omp.h>
+
+namespace
+{
+  /*!
+   * \brief Политика ожидания сообщений.
+   *
+   * SPIN - поток непрерывно опрашивает хранилище сообщений.
+   * ADAPTIVE - поток опрашивает хранилище WAIT_SPIN_COUNT раз, после чего засыпает до прихода нового сообщения.
+   */
+  enum WaitPolicy
+  {
+	SPIN = 0,
+	ADAPTIVE = 1
+  };
+
+  constexpr int THREADS = 8;
+  constexpr WaitPolicy WAIT_POLICY = WaitPolicy::ADAPTIVE;
+  constexpr int WAIT_SPIN_COUNT = 4000;
+
+  /*!
+   * \brief Сообщение. Содержит данные и информацию об отправителе.
+   */
+  struct Message
+  {
+	static const int ANY_THREAD = -1;
+	static const int ANY_TAG = -1;
+
+	Message() :
+	  data{ nullptr },
+	  count{ 0 },
+	  typeSize{ 0 },
+	  bufferClass{ 0 },
+	  senderId{ ANY_THREAD },
+	  ownerId{ ANY_THREAD },
+	  tag{ ANY_TAG },
+	  ownsData{ false },
+	  delivered{ false },
+	  sequence{ 0 },
+	  next{ nullptr }
+	{}
+
+	Message(const Message&) = delete;
+	Message& operator=(const Message&) = delete;
+	Message(Message&&) = delete;
+	Message& operator=(Message&&) = delete;
+
+	/*!
+	 * \brief Скопировать данные в буфер сообщения. Буфер выделяется пулом сообщений (MessagePool::acquireMessage).
+	 */
+	void setData(void* data, int count, int typeSize, int senderId = ANY_THREAD, int tag = ANY_TAG)
+	{
+	  this->senderId = senderId;
+	  this->count = count;
+	  this->typeSize = typeSize;
+	  this->tag = tag;
+	  this->ownsData = true;
+	  std::memcpy(this->data, data, count * typeSize);
+	}
+
+	/*!
+	 * \brief Передать в сообщении указатель на буфер отправителя без копирования данных (режим рандеву).
+	 *
+	 * Буфер должен оставаться неизменным до тех пор, пока получатель не выставит флаг delivered.
+	 */
+	void setReference(void* data, int count, int typeSize, int senderId = ANY_THREAD, int tag = ANY_TAG)
+	{
+	  reset();
+	  this->senderId = senderId;
+	  this->count = count;
+	  this->typeSize = typeSize;
+	  this->data = data;
+	  this->tag = tag;
+	}
+
+	void reset()
+	{
+	  data = nullptr;
+	  count = 0;
+	  typeSize = 0;
+	  senderId = ANY_THREAD;
+	  tag = ANY_TAG;
+	  ownsData = false;
+	  delivered.store(false, std::memory_order_relaxed);
+	}
+
+	void* data;		    // Указатель на данные
+	size_t count;		// Количество данных
+	size_t typeSize;	// Размер типа данных
+	int bufferClass;	// Класс размера буфера данных в пуле сообщений
+	short int senderId; // ID потока-отправителя
+	short int ownerId;	// ID потока, пулу которого принадлежит сообщение
+	short int tag;		// Тег сообщения
+	bool ownsData;		// Данные скопированы в буфер из пула (иначе указывают на буфер отправителя)
+	std::atomic<bool> delivered; // Получатель скопировал данные из буфера отправителя (режим рандеву)
+	size_t sequence;	// Порядковый номер сообщения в хранилище получателя
+	Message* next;		// Следующее сообщение в очереди
+  };
+
+  /*!
+   * \brief Очередь сообщений (FIFO) на основе интрусивного списка.
+   */
+  struct MessageQueue
+  {
+	Message* first = nullptr;	// Начало очереди
+	Message* last = nullptr;	// Конец очереди
+
+	void push(Message* message)
+	{
+	  message->next = nullptr;
+
+	  if (last == nullptr)
+	  {
+		first = message;
+	  }
+	  else
+	  {
+		last->next = message;
+	  }
+	  last = message;
+	}
+
+	Message* pop()
+	{
+	  Message* message = first;
+	  first = message->next;
+
+	  if (first == nullptr)
+	  {
+		last = nullptr;
+	  }
+
+	  message->next = nullptr;
+	  return message;
+	}
+  };
+
+  /*!
+   * \brief Пул сообщений потока. Переиспользует заголовки сообщений и буферы данных.
+   *
+   * Буферы разбиты на классы по размеру (степени двойки от 2^MIN_SIZE_CLASS до 2^(SIZE_CLASSES - 1) байт),
+   * буферы большего размера выделяются и освобождаются напрямую. Получатель возвращает сообщение в пул потока-владельца
+   * через lock-free стек возвращенных сообщений, который владелец забирает целиком при следующем выделении.
+   */
+  struct MessagePool
+  {
+	static const int MIN_SIZE_CLASS = 4;
+	static const int SIZE_CLASSES = 25;
+
+	explicit MessagePool() :
+	  freeMessages{ nullptr },
+	  freeBuffers{},
+	  returned{ nullptr },
+	  messageHits{ 0 },
+	  messageMisses{ 0 },
+	  bufferHits{ 0 },
+	  bufferMisses{ 0 }
+	{}
+
+	MessagePool(const MessagePool&) = delete;
+	MessagePool& operator=(const MessagePool&) = delete;
+
+	/*!
+	 * \brief Освободить заголовки и буферы, накопленные пулом, в том числе возвращенные получателями.
+	 */
+	~MessagePool()
+	{
+	  collectReturned();
+
+	  while (freeMessages != nullptr)
+	  {
+		Message* next = freeMessages->next;
+		delete freeMessages;
+		freeMessages = next;
+	  }
+
+	  for (char*& buffer : freeBuffers)
+	  {
+		while (buffer != nullptr)
+		{
+		  char* next = *reinterpret_cast<char**>(buffer);
+		  delete[] buffer;
+		  buffer = next;
+		}
+	  }
+	}
+
+	/*!
+	 * \brief Выделить сообщение с буфером данных размером не менее size байт. Вызывается только потоком-владельцем.
+	 */
+	Message* acquireMessage(int ownerId, size_t size)
+	{
+	  if (returned.load(std::memory_order_relaxed) != nullptr)
+	  {
+		collectReturned();
+	  }
+
+	  Message* message = freeMessages;
+
+	  if (message != nullptr)
+	  {
+		freeMessages = message->next;
+		message->next = nullptr;
+		++messageHits;
+	  }
+	  else
+	  {
+		message = new Message;
+		++messageMisses;
+	  }
+
+	  message->ownerId = ownerId;
+	  message->bufferClass = getSizeClass(size);
+	  message->data = acquireBuffer(message->bufferClass, size);
+
+	  return message;
+	}
+
+	/*!
+	 * \brief Вернуть сообщение в пул. Может вызываться любым потоком.
+	 */
+	void releaseMessage(Message* message)
+	{
+	  message->next = returned.load(std::memory_order_relaxed);
+
+	  while (!returned.compare_exchange_weak(message->next, message, std::memory_order_release, std::memory_order_relaxed))
+	  {
+	  }
+	}
+
+	void* acquireBuffer(int sizeClass, size_t size)
+	{
+	  if (sizeClass >= SIZE_CLASSES)
+	  {
+		++bufferMisses;
+		return new char[size];
+	  }
+
+	  char* buffer = freeBuffers[sizeClass];
+
+	  if (buffer != nullptr)
+	  {
+		freeBuffers[sizeClass] = *reinterpret_cast<char**>(buffer);
+		++bufferHits;
+		return buffer;
+	  }
+
+	  ++bufferMisses;
+	  return new char[static_cast<size_t>(1) << sizeClass];
+	}
+
+	/*!
+	 * \brief Перенести возвращенные сообщения и их буферы в списки свободных.
+	 */
+	void collectReturned()
+	{
+	  Message* message = returned.exchange(nullptr, std::memory_order_acquire);
+
+	  while (message != nullptr)
+	  {
+		Message* next = message->next;
+		char* buffer = static_cast<char*>(message->data);
+
+		if (message->bufferClass < SIZE_CLASSES)
+		{
+		  *reinterpret_cast<char**>(buffer) = freeBuffers[message->bufferClass];
+		  freeBuffers[message->bufferClass] = buffer;
+		}
+		else
+		{
+		  delete[] buffer;
+		}
+
+		message->data = nullptr;
+		message->next = freeMessages;
+		freeMessages = message;
+		message = next;
+	  }
+	}
+
+	static int getSizeClass(size_t size)
+	{
+	  int sizeClass = MIN_SIZE_CLASS;
+
+	  while ((static_cast<size_t>(1) << sizeClass) < size)
+	  {
+		++sizeClass;
+	  }
+
+	  return sizeClass;
+	}
+
+	Message* freeMessages;				// Список свободных заголовков (доступен только потоку-владельцу)
+	char* freeBuffers[SIZE_CLASSES];		// Списки свободных буферов по классам размера
+	std::atomic<Message*> returned;		// Стек сообщений, возвращенных получателями
+	size_t messageHits;					// Заголовки, взятые из пула
+	size_t messageMisses;					// Заголовки, выделенные в куче
+	size_t bufferHits;					// Буферы, взятые из пула
+	size_t bufferMisses;					// Буферы, выделенные в куче
+  };
+
+  /*!
+   * \brief Хранилище сообщений. Хранит сообщения для определенного потока.
+   *
+   * Отправители добавляют сообщения в стек входящих сообщений без блокировок (CAS на вершине стека).
+   * Поток-владелец забирает стек целиком и раскладывает сообщения по очередям, доступ к которым имеет только он,
+   * поэтому ни отправка, ни поиск сообщения не требуют взятия мьютекса.
+   *
+   * Для каждой пары (отправитель, тег) хранится отдельная очередь, поэтому прием от конкретного потока с конкретным
+   * тегом выполняется за O(1). При приеме с ANY_THREAD/ANY_TAG выбирается сообщение с наименьшим порядковым номером
+   * среди голов подходящих очередей, что сохраняет порядок поступления сообщений.
+   */
+  struct ThreadInputStorage
+  {
+	explicit ThreadInputStorage() :
+	  incoming{ nullptr },
+	  queues{},
+	  nextSequence{ 0 },
+	  sleeping{ false },
+	  sleepMutex{},
+	  wakeup{}
+	{}
+
+	void pushMessage(Message* message)
+	{
+	  message->next = incoming.load(std::memory_order_relaxed);
+
+	  while (!incoming.compare_exchange_weak(message->next, message, std::memory_order_release, std::memory_order_relaxed))
+	  {
+	  }
+
+	  notify();
+	}
+
+	/*!
+	 * \brief Разбудить поток-владельца, если он спит в ожидании.
+	 */
+	void notify()
+	{
+	  if (WAIT_POLICY != WaitPolicy::ADAPTIVE)
+	  {
+		return;
+	  }
+
+	  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	  if (sleeping.load(std::memory_order_relaxed))
+	  {
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		wakeup.notify_one();
+	  }
+	}
+
+	/*!
+	 * \brief Усыпить поток-владельца до выполнения условия. Условие перепроверяется после каждого вызова notify().
+	 */
+	template<typename Condition>
+	void sleepUntil(Condition ready)
+	{
+	  std::unique_lock<std::mutex> lock(sleepMutex);
+	  sleeping.store(true, std::memory_order_relaxed);
+	  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	  while (!ready())
+	  {
+		wakeup.wait(lock);
+	  }
+
+	  sleeping.store(false, std::memory_order_relaxed);
+	}
+
+	/*!
+	 * \brief Дождаться выполнения условия согласно политике WAIT_POLICY.
+	 */
+	template<typename Condition>
+	void waitUntil(Condition ready)
+	{
+	  for (int spins = 0; !ready(); ++spins)
+	  {
+		if (WAIT_POLICY == WaitPolicy::ADAPTIVE && spins >= WAIT_SPIN_COUNT)
+		{
+		  sleepUntil(ready);
+		  return;
+		}
+	  }
+	}
+
+	Message* popMessage(int senderId = Message::ANY_THREAD, int messageTag = Message::ANY_TAG)
+	{
+	  Message* result = findMessage(senderId, messageTag);
+
+	  if (result == nullptr && incoming.load(std::memory_order_relaxed) != nullptr)
+	  {
+		collectIncoming();
+		result = findMessage(senderId, messageTag);
+	  }
+
+	  return result;
+	}
+
+	/*!
+	 * \brief Разложить входящие сообщения по очередям потока-владельца, сохраняя порядок их отправки.
+	 */
+	void collectIncoming()
+	{
+	  Message* message = incoming.exchange(nullptr, std::memory_order_acquire);
+	  Message* head = nullptr;
+
+	  while (message != nullptr)
+	  {
+		Message* next = message->next;
+		message->next = head;
+		head = message;
+		message = next;
+	  }
+
+	  while (head != nullptr)
+	  {
+		Message* next = head->next;
+		head->sequence = nextSequence++;
+		queues[head->senderId][head->tag].push(head);
+		head = next;
+	  }
+	}
+
+	/*!
+	 * \brief Найти и извлечь из очередей потока-владельца самое раннее подходящее сообщение.
+	 */
+	Message* findMessage(int senderId, int messageTag)
+	{
+	  if (senderId != Message::ANY_THREAD && (senderId < 0 || senderId >= THREADS))
+	  {
+		return nullptr;
+	  }
+
+	  const int firstSource = (senderId == Message::ANY_THREAD) ? 0 : senderId;
+	  const int lastSource = (senderId == Message::ANY_THREAD) ? THREADS - 1 : senderId;
+	  MessageQueue* result = nullptr;
+
+	  const auto selectQueue = [&result](MessageQueue& queue)
+	  {
+		if (queue.first != nullptr && (result == nullptr || queue.first->sequence < result->first->sequence))
+		{
+		  result = &queue;
+		}
+	  };
+
+	  for (int source = firstSource; source <= lastSource; ++source)
+	  {
+		auto& sourceQueues = queues[source];
+
+		if (messageTag == Message::ANY_TAG)
+		{
+		  for (auto& tagQueue : sourceQueues)
+		  {
+			selectQueue(tagQueue.second);
+		  }
+		}
+		else
+		{
+		  const auto it = sourceQueues.find(messageTag);
+		  if (it != sourceQueues.end())
+		  {
+			selectQueue(it->second);
+		  }
+		}
+	  }
+
+	  return (result != nullptr) ? result->pop() : nullptr;
+	}
+
+	std::atomic<Message*> incoming;	// Стек входящих сообщений (заполняется отправителями)
+	std::array<std::unordered_map<int, MessageQueue>, THREADS> queues; // Очереди сообщений по отправителю и тегу (доступны только потоку-владельцу)
+	size_t nextSequence;		// Порядковый номер следующего сообщения
+	std::atomic<bool> sleeping;	// Поток-владелец спит в ожидании notify()
+	std::mutex sleepMutex;		// Мьютекс условной переменной
+	std::condition_variable wakeup; // Условная переменная пробуждения потока-владельца
+  };
+
+  constexpr size_t RENDEZVOUS_THRESHOLD = 64 * 1024; // Размер сообщения в байтах, начиная с которого данные не копируются в сообщение
+  constexpr size_t BROADCAST_PIPELINE_THRESHOLD = 256 * 1024; // Размер сообщения в байтах, начиная с которого рассылка идет по конвейеру
+  constexpr size_t BROADCAST_CHUNK_SIZE = 32 * 1024; // Размер части сообщения при конвейерной рассылке (меньше RENDEZVOUS_THRESHOLD)
+  std::array<ThreadInputStorage, THREADS> INPUT_STORAGES;
+  std::array<MessagePool, THREADS> MESSAGE_POOLS;
+
+  /*!
+   * \brief Коммутатор. Группа потоков, участвующих в коллективной операции.
+   *
+   * Ранг потока в коммутаторе - порядковый номер его ID среди ID потоков группы.
+   */
+  struct Commutator
+  {
+	explicit Commutator() :
+	  threads{},
+	  storageLock{ nullptr }
+	{
+	  omp_init_lock(&storageLock);
+	}
+
+	~Commutator()
+	{
+	  omp_destroy_lock(&storageLock);
+	}
+
+	void addThread(int threadId)
+	{
+	  omp_set_lock(&storageLock);
+	  threads.insert(threadId);
+	  omp_unset_lock(&storageLock);
+	}
+
+	int getRank(int threadId) const
+	{
+	  const auto it = threads.find(threadId);
+	  return (it != threads.end()) ? static_cast<int>(std::distance(threads.begin(), it)) : -1;
+	}
+
+	int getThreadId(int rank) const
+	{
+	  return *std::next(threads.begin(), rank);
+	}
+
+	int size() const
+	{
+	  return static_cast<int>(threads.size());
+	}
+
+	std::set<int> threads;
+	omp_lock_t storageLock;
+  };
+
+  /*!
+   * \brief Топология процессов в виде сетки.
+   */
+  struct ThreadGrid
+  {
+	int rows = 0;
+	int columns = 0;
+	std::vector<std::vector<int>> grid {};
+	omp_lock_t storageLock = nullptr;
+
+	ThreadGrid(int rows, int columns)
+	{
+	  omp_init_lock(&storageLock);
+
+	  if (rows * columns < THREADS)
+	  {
+		throw std::runtime_error("Too big grid size.");
+	  }
+
+	  this->rows = rows;
+	  this->columns = columns;
+
+	  grid.resize(rows);
+	  for (int i = 0; i < rows; ++i)
+	  {
+		grid[i].resize(columns);
+	  }
+
+	  for (int i = 0; i < rows; ++i)
+	  {
+		for (int j = 0; j < columns; ++j)
+		{
+		  grid[i][j] = i * columns + j;
+		}
+	  }
+	}
+
+	~ThreadGrid()
+	{
+	  omp_destroy_lock(&storageLock);
+	}
+
+	int getThreadIdByCoords(int row, int column)
+	{
+	  if (row < 0 || row > rows || column < 0 || column > columns)
+	  {
+		throw std::runtime_error("Invalid indexes.");
+	  }
+
+	  omp_set_lock(&storageLock);
+	  const int id = grid[row][column];
+	  omp_unset_lock(&storageLock);
+
+	  return id;
+	}
+
+	std::pair<int, int> getCoordsByThreadId(int id)
+	{
+	  omp_set_lock(&storageLock);
+	  for (int i = 0; i < rows; ++i)
+	  {
+		for (int j = 0; j < columns; ++j)
+		{
+		  if (id == grid[i][j])
+		  {
+			omp_unset_lock(&storageLock);
+			return { i, j };
+		  }
+		}
+	  }
+	  omp_unset_lock(&storageLock);
+	  return { -1, -1 };
+	}
+
+	void shift(int direction, int disp, int& sourceThreadId, int& destThreadId)
+	{
+	  static const auto fixIndex = [](int& index, int size)
+	  {
+		if (index < 0)
+		{
+		  int k = abs(index) / size;
+		  index += (k + 1) * size;
+		}
+		index %= size;
+	  };
+
+	  const auto threadId = omp_get_thread_num();
+	  const auto threadCoords = getCoordsByThreadId(threadId);
+
+	  int sourceRow = threadCoords.first;
+	  int sourceColumn = threadCoords.second;
+	  int destRow = threadCoords.first;
+	  int destColumn = threadCoords.second;
+
+	  if (direction == 0)
+	  {
+		sourceRow -= disp;
+		destRow += disp;
+		fixIndex(sourceRow, rows);
+		fixIndex(destRow, rows);
+	  }
+
+	  if (direction == 1)
+	  {
+		sourceColumn -= disp;
+		destColumn += disp;
+		fixIndex(sourceColumn, columns);
+		fixIndex(destColumn, columns);
+	  }
+
+	  sourceThreadId = getThreadIdByCoords(sourceRow, sourceColumn);
+	  destThreadId = getThreadIdByCoords(destRow, destColumn);
+	}
+
+	/*!
+	 * \brief Выделить подгруппу сетки, содержащую текущий поток (аналог MPI_Cart_sub).
+	 *
+	 * В подгруппу попадают потоки, координаты которых совпадают с координатами текущего потока во всех измерениях,
+	 * не отмеченных в remainDims. Например, remainDims = { true, false } дает столбец сетки, в котором находится поток.
+	 *
+	 * \param remainDims Признаки сохранения измерений (строки, столбцы) в подгруппе
+	 * \param commutator Коммутатор, в который будут добавлены потоки подгруппы
+	 */
+	void sub(const std::array<bool, 2>& remainDims, Commutator& commutator)
+	{
+	  const auto threadCoords = getCoordsByThreadId(omp_get_thread_num());
+
+	  for (int i = 0; i < rows; ++i)
+	  {
+		for (int j = 0; j < columns; ++j)
+		{
+		  if ((remainDims[0] || i == threadCoords.first) && (remainDims[1] || j == threadCoords.second))
+		  {
+			commutator.addThread(getThreadIdByCoords(i, j));
+		  }
+		}
+	  }
+	}
+  };
+
+  /*!
+   * \brief Вывести долю заголовков и буферов сообщений, взятых из пулов потоков.
+   */
+  void printMessagePoolStatistics()
+  {
+	size_t messageHits = 0, messageMisses = 0, bufferHits = 0, bufferMisses = 0;
+
+	for (const auto& pool : MESSAGE_POOLS)
+	{
+	  messageHits += pool.messageHits;
+	  messageMisses += pool.messageMisses;
+	  bufferHits += pool.bufferHits;
+	  bufferMisses += pool.bufferMisses;
+	}
+
+	std::cout << "Message pool hit rate: headers " << messageHits << "/" << messageHits + messageMisses
+	  << ", buffers " << bufferHits << "/" << bufferHits + bufferMisses << "\n";
+  }
+
+  /*!
+   * \brief Дождаться, пока получатель скопирует данные сообщения, переданного в режиме рандеву.
+   */
+  void waitDelivery(const Message& message)
+  {
+	INPUT_STORAGES.at(omp_get_thread_num()).waitUntil([&message]()
+	{
+	  return message.delivered.load(std::memory_order_acquire);
+	});
+  }
+
+  /*!
+   * \brief Освободить полученное сообщение. Отправитель сообщения в режиме рандеву уведомляется о завершении копирования.
+   */
+  void releaseMessage(Message* message)
+  {
+	if (message->ownsData)
+	{
+	  MESSAGE_POOLS.at(message->ownerId).releaseMessage(message);
+	}
+	else
+	{
+	  // После выставления флага отправитель может уничтожить сообщение, поэтому хранилище отправителя определяется заранее
+	  auto& senderStorage = INPUT_STORAGES.at(message->senderId);
+	  message->delivered.store(true, std::memory_order_release);
+	  senderStorage.notify();
+	}
+  }
+
+  /*!
+   * \brief Скопировать данные полученного сообщения в буфер получателя и освободить сообщение.
+   */
+  void consumeMessage(Message* message, void* data, int count, int typeSize)
+  {
+	size_t size = count * typeSize;
+	if (size > message->count * message->typeSize)
+	{
+	  size = message->count * message->typeSize;
+	}
+
+	std::memcpy(data, message->data, size);
+
+	releaseMessage(message);
+  }
+
+  /*!
+   * \brief Функция отправки сообщения другому потоку.
+   *
+   * Функция является блокирующей - освобождается после того, как данные из входного буффера будут скопированы и отправлены.
+   * Сообщения размером от RENDEZVOUS_THRESHOLD байт другим потокам передаются без промежуточной копии: функция
+   * освобождается после того, как получатель скопирует данные напрямую из входного буффера. Поэтому два потока
+   * не должны отправлять такие сообщения друг другу до вызова recieveData. Сообщения самому себе всегда копируются.
+   *
+   * \param data Указатель на массив данных, который необходимо отправить
+   * \param count Количество элементов в массиве данных
+   * \param typeSize Размер одного элемента массива в байтах
+   * \param destination ID потока, которому необходимо отправить сообщение
+   * \param tag Тег сообщения
+   */
+  void sendData(void* data, int count, int typeSize, int destination, int tag = Message::ANY_TAG)
+  {
+	if (destination < 0 || destination >= THREADS)
+	{
+	  return;
+	}
+
+	auto& storage = INPUT_STORAGES.at(destination);
+
+	if (static_cast<size_t>(count) * typeSize >= RENDEZVOUS_THRESHOLD && destination != omp_get_thread_num())
+	{
+	  Message message;
+	  message.setReference(data, count, typeSize, omp_get_thread_num(), tag);
+	  storage.pushMessage(&message);
+	  waitDelivery(message);
+	  return;
+	}
+
+	const auto threadId = omp_get_thread_num();
+	auto* message = MESSAGE_POOLS.at(threadId).acquireMessage(threadId, static_cast<size_t>(count) * typeSize);
+	message->setData(data, count, typeSize, threadId, tag);
+	storage.pushMessage(message);
+  }
+
+  /*!
+   * \brief Функция приема сообщения от другого потока.
+   *
+   * Функция является блокирующей - освобождается после того, как данные из сообщения буду получены.
+   *
+   * \param data Указатель на массив данных, куда необходимо записать полученные данные
+   * \param count Количество элементов в массиве данных
+   * \param typeSize Размер одного элемента массива в байтах
+   * \param source ID потока, от которого необходимо получить сообщение
+   * \param tag Тег сообщения
+   */
+  void recieveData(void* data, int count, int typeSize, int source = Message::ANY_THREAD, int tag = Message::ANY_TAG)
+  {
+	auto& storage = INPUT_STORAGES.at(omp_get_thread_num());
+	auto* message = storage.popMessage(source, tag);
+
+	while (message == nullptr)
+	{
+	  storage.waitUntil([&storage]()
+	  {
+		return storage.incoming.load(std::memory_order_relaxed) != nullptr;
+	  });
+	  message = storage.popMessage(source, tag);
+	}
+
+	consumeMessage(message, data, count, typeSize);
+  }
+
+  /*!
+   * \brief Функция рассылки данных от одного потока всем потокам коммутатора.
+   *
+   * Функция является блокирующей - освобождается после того, как данные будут отправлены (для корня) или получены.
+   * Короткие сообщения рассылаются по биномиальному дереву за log(P) шагов. Сообщения от BROADCAST_PIPELINE_THRESHOLD байт
+   * передаются по цепочке частями по BROADCAST_CHUNK_SIZE байт: пока поток принимает очередную часть, предыдущие
+   * уже передаются дальше по цепочке, поэтому время рассылки почти не зависит от числа потоков.
+   *
+   * \param data Указатель на массив данных (у корня - отправляемые данные, у остальных - буфер приема)
+   * \param count Количество элементов в массиве данных
+   * \param typeSize Размер одного элемента массива в байтах
+   * \param root Ранг потока-корня в коммутаторе
+   * \param commutator Коммутатор, потокам которого рассылаются данные
+   */
+  void broadcastData(void* data, int count, int typeSize, int root, const Commutator& commutator)
+  {
+	const int size = commutator.size();
+	const int rank = (commutator.getRank(omp_get_thread_num()) - root + size) % size;
+	const auto getThreadId = [&commutator, root, size](int rank)
+	{
+	  return commutator.getThreadId((rank + root) % size);
+	};
+
+	const size_t totalSize = static_cast<size_t>(count) * typeSize;
+
+	if (totalSize >= BROADCAST_PIPELINE_THRESHOLD && size > 2)
+	{
+	  uint8_t* bytes = static_cast<uint8_t*>(data);
+
+	  for (size_t offset = 0; offset < totalSize; offset += BROADCAST_CHUNK_SIZE)
+	  {
+		const int chunkSize = static_cast<int>((totalSize - offset < BROADCAST_CHUNK_SIZE) ? totalSize - offset : BROADCAST_CHUNK_SIZE);
+
+		if (rank > 0)
+		{
+		  recieveData(bytes + offset, chunkSize, 1, getThreadId(rank - 1));
+		}
+
+		if (rank + 1 < size)
+		{
+		  sendData(bytes + offset, chunkSize, 1, getThreadId(rank + 1));
+		}
+	  }
+
+	  return;
+	}
+
+	int mask = 1;
+
+	while (mask < size)
+	{
+	  if (rank & mask)
+	  {
+		recieveData(data, count, typeSize, getThreadId(rank - mask));
+		break;
+	  }
+	  mask <<= 1;
+	}
+
+	for (mask >>= 1; mask > 0; mask >>= 1)
+	{
+	  if (rank + mask < size)
+	  {
+		sendData(data, count, typeSize, getThreadId(rank + mask));
+	  }
+	}
+  }
+}
+
+int main()
+{
+  if (THREADS % 2 == 1)
+  {
+	std::cout << "The number of threads must be even.\n";
+	return 0;
+  }
+
+  ThreadGrid grid(THREADS / 2, 2);
+  double maxTime = 0.0;
+
+  #pragma omp parallel num_threads(THREADS)
+  {
+	const auto threadId = omp_get_thread_num();
+
+	Commutator rowCommutator;
+	grid.sub({ true, false }, rowCommutator);
+
+	double data = 0.0;
+
+	if (threadId == 0) {
+	  data = 5;
+	} else if (threadId == 1) {
+	  data = 2.5;
+	}
+
+	#pragma omp barrier
+	double startTime = omp_get_wtime();
+	broadcastData(&data, 1, sizeof(double), 0, rowCommutator);
+	double elapsedTime = omp_get_wtime() - startTime;
+
+	#pragma omp critical
+	{
+	  std::cout << "Process: " << threadId << ", data: " << data << "\n";
+
+	  if (elapsedTime > maxTime)
+	  {
+		maxTime = elapsedTime;
+	  }
+	}
+  }
+
+  std::cout << "Elapsed time: " << maxTime << " seconds\n";
+  printMessagePoolStatistics();
+
+  return 0;
+}
@@ -0,0 +1,179 @@
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+
+#include "matrix-file.h"
+
+// Преобразование матриц между текстовым форматом (элементы строки матрицы через пробел, строки матрицы
+// на отдельных строках файла) и двоичным форматом из matrix-file.h:
+//   matrix-convert to-binary input.txt output.bin [int | float | double] [blockColumns blockRows]
+//   matrix-convert to-text input.bin output.txt
+// Размеры матрицы определяются по тексту: ширина - число элементов в первой строке.
+// Если задана разбивка на блоки, двоичный файл записывается в порядке блоков программ лабораторной 6
+// (блоки дополняются нулями), и программа с той же разбивкой загружает его одним копированием.
+
+namespace matrix_convert_functions
+{
+  template<typename T>
+  bool convertToBinary(const std::string& inputPath, const std::string& outputPath, size_t blockColumns, size_t blockRows)
+  {
+	std::ifstream input(inputPath, std::ios::binary);
+
+	if (!input.is_open())
+	{
+	  return false;
+	}
+
+	const std::string text((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+	const char* position = text.c_str();
+	std::vector<T> values;
+	size_t width = 0;
+
+	// Текст разбирается целиком в памяти через strtod, а не поэлементно через operator>>
+	while (true)
+	{
+	  char* end;
+	  const double value = std::strtod(position, &end);
+
+	  if (end == position)
+	  {
+		break;
+	  }
+
+	  // Перевод строки перед очередным элементом завершает первую строку матрицы
+	  if (width == 0 && !values.empty() && std::find(position, static_cast<const char*>(end), '\n') != end)
+	  {
+		width = values.size();
+	  }
+
+	  values.push_back(static_cast<T>(value));
+	  position = end;
+	}
+
+	if (width == 0)
+	{
+	  width = values.size();
+	}
+
+	const size_t height = width != 0 ? values.size() / width : 0;
+
+	// Матрица должна быть прямоугольной, а текст после последнего элемента - пустым
+	if (width == 0 || values.size() != width * height
+	  || text.find_first_not_of(" \t\r\n", static_cast<size_t>(position - text.c_str())) != std::string::npos)
+	{
+	  return false;
+	}
+
+	const matrix_file::MatrixFileHeader header(matrix_file::ElementKindOf<T>::value, width, height, blockColumns, blockRows,
+	  (width + blockColumns - 1) / blockColumns, (height + blockRows - 1) / blockRows);
+	std::vector<T> data(header.getElementCount(), 0);
+
+	for (size_t y = 0; y < height; ++y)
+	{
+	  for (size_t x = 0; x < width; ++x)
+	  {
+		data[header.getElementOffset(x, y)] = values[y * width + x];
+	  }
+	}
+
+	std::cout << "Matrix " << height << "x" << width << ", blocks " << blockRows << "x" << blockColumns << "\n";
+
+	return matrix_file::writeMatrixFile(outputPath, header, data.data());
+  }
+
+  template<typename T>
+  bool convertToText(const matrix_file::MappedMatrixFile& file, const std::string& outputPath)
+  {
+	std::ofstream output(outputPath);
+
+	if (!output.is_open())
+	{
+	  return false;
+	}
+
+	std::vector<T> row(file.header.width);
+
+	for (size_t y = 0; y < file.header.height; ++y)
+	{
+	  file.readRowSegment(y, 0, row.size(), row.data());
+
+	  for (size_t x = 0; x < row.size(); ++x)
+	  {
+		output << row[x] << " ";
+	  }
+	  output << "\n";
+	}
+
+	return output.good();
+  }
+}
+
+using namespace matrix_convert_functions;
+
+int main(int argc, char** argv)
+{
+  const std::string mode = argc > 1 ? argv[1] : "";
+  bool converted = false;
+
+  if (mode == "to-binary" && (argc == 4 || argc == 5 || argc == 7))
+  {
+	const std::string elementType = argc > 4 ? argv[4] : "int";
+	const size_t blockColumns = argc > 6 ? std::strtoull(argv[5], nullptr, 10) : 1;
+	const size_t blockRows = argc > 6 ? std::strtoull(argv[6], nullptr, 10) : 1;
+
+	if (blockColumns == 0 || blockRows == 0)
+	{
+	  converted = false;
+	}
+	else if (elementType == "int")
+	{
+	  converted = convertToBinary<int32_t>(argv[2], argv[3], blockColumns, blockRows);
+	}
+	else if (elementType == "float")
+	{
+	  converted = convertToBinary<float>(argv[2], argv[3], blockColumns, blockRows);
+	}
+	else if (elementType == "double")
+	{
+	  converted = convertToBinary<double>(argv[2], argv[3], blockColumns, blockRows);
+	}
+  }
+  else if (mode == "to-text" && argc == 4)
+  {
+	matrix_file::MappedMatrixFile file;
+
+	if (file.open(argv[2]))
+	{
+	  switch (file.header.elementKind)
+	  {
+	  case matrix_file::ElementKind::INT32:
+		converted = convertToText<int32_t>(file, argv[3]);
+		break;
+	  case matrix_file::ElementKind::FLOAT32:
+		converted = convertToText<float>(file, argv[3]);
+		break;
+	  default:
+		converted = convertToText<double>(file, argv[3]);
+		break;
+	  }
+	}
+  }
+  else
+  {
+	std::cerr << "Usage: " << argv[0] << " to-binary input.txt output.bin [int | float | double] [blockColumns blockRows]\n"
+	  << "       " << argv[0] << " to-text input.bin output.txt\n";
+	return 0;
+  }
+
+  if (!converted)
+  {
+	std::cerr << "Conversion failed.\n";
+	return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,319 @@
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace matrix_file
+{
+  /*!
+   * \brief Тип элементов матрицы в файле.
+   */
+  enum ElementKind : uint32_t
+  {
+	INT32 = 1,
+	FLOAT32 = 2,
+	FLOAT64 = 3
+  };
+
+  /*!
+   * \brief Порядок блоков в файле: BLOCK_COLUMNS - блок (x, y) имеет номер x * blockRows + y (как в программах лабораторной 6),
+   * BLOCK_ROWS - номер y * blockColumns + x. Внутри блока элементы всегда хранятся по строкам.
+   */
+  enum BlockOrder : uint32_t
+  {
+	BLOCK_COLUMNS = 0,
+	BLOCK_ROWS = 1
+  };
+
+  template<typename T>
+  struct ElementKindOf;
+
+  template<>
+  struct ElementKindOf<int32_t>
+  {
+	static constexpr ElementKind value = ElementKind::INT32;
+  };
+
+  template<>
+  struct ElementKindOf<float>
+  {
+	static constexpr ElementKind value = ElementKind::FLOAT32;
+  };
+
+  template<>
+  struct ElementKindOf<double>
+  {
+	static constexpr ElementKind value = ElementKind::FLOAT64;
+  };
+
+  /*!
+   * \brief Заголовок двоичного файла матрицы (64 байта, порядок байтов машины, записавшей файл).
+   *
+   * Матрица width x height разбита на blockColumns x blockRows блоков blockWidth x blockHeight, дополненных нулями.
+   * Сразу за заголовком блоки лежат подряд в порядке blockOrder, поэтому файл с той же разбивкой, что и матрица
+   * в программе, отображается в память и копируется одним блоком. Матрица по строкам - частный случай с одним блоком.
+   */
+  struct MatrixFileHeader
+  {
+	char magic[4] = { 'M', 'T', 'X', 'B' };
+	uint32_t version = 1;
+	uint32_t elementKind = 0;
+	uint32_t blockOrder = BlockOrder::BLOCK_COLUMNS;
+	uint64_t width = 0;
+	uint64_t height = 0;
+	uint64_t blockColumns = 0;
+	uint64_t blockRows = 0;
+	uint64_t blockWidth = 0;
+	uint64_t blockHeight = 0;
+
+	MatrixFileHeader() = default;
+
+	MatrixFileHeader(ElementKind elementKind, uint64_t width, uint64_t height, uint64_t blockColumns, uint64_t blockRows,
+	  uint64_t blockWidth, uint64_t blockHeight, BlockOrder blockOrder = BlockOrder::BLOCK_COLUMNS)
+	{
+	  this->elementKind = elementKind;
+	  this->blockOrder = blockOrder;
+	  this->width = width;
+	  this->height = height;
+	  this->blockColumns = blockColumns;
+	  this->blockRows = blockRows;
+	  this->blockWidth = blockWidth;
+	  this->blockHeight = blockHeight;
+	}
+
+	bool isValid() const
+	{
+	  return std::memcmp(magic, MatrixFileHeader().magic, sizeof(magic)) == 0 && version == 1
+		&& elementKind >= ElementKind::INT32 && elementKind <= ElementKind::FLOAT64 && blockOrder <= BlockOrder::BLOCK_ROWS
+		&& blockColumns * blockWidth >= width && blockRows * blockHeight >= height;
+	}
+
+	size_t getElementSize() const
+	{
+	  return elementKind == ElementKind::FLOAT64 ? 8 : 4;
+	}
+
+	uint64_t getElementCount() const
+	{
+	  return blockColumns * blockRows * blockWidth * blockHeight;
+	}
+
+	/*!
+	 * \brief Номер элемента (columnIndex, rowIndex) среди данных файла.
+	 */
+	uint64_t getElementOffset(uint64_t columnIndex, uint64_t rowIndex) const
+	{
+	  const uint64_t x = columnIndex / blockWidth;
+	  const uint64_t y = rowIndex / blockHeight;
+	  const uint64_t block = blockOrder == BlockOrder::BLOCK_COLUMNS ? x * blockRows + y : y * blockColumns + x;
+
+	  return block * blockWidth * blockHeight + (rowIndex % blockHeight) * blockWidth + columnIndex % blockWidth;
+	}
+
+	/*!
+	 * \brief Совпадает ли разбивка на блоки (тогда данные файла и матрицы в памяти совпадают побайтно).
+	 */
+	bool hasSameLayout(const MatrixFileHeader& other) const
+	{
+	  return elementKind == other.elementKind && blockOrder == other.blockOrder && width == other.width
+		&& height == other.height && blockColumns == other.blockColumns && blockRows == other.blockRows
+		&& blockWidth == other.blockWidth && blockHeight == other.blockHeight;
+	}
+  };
+
+  static_assert(sizeof(MatrixFileHeader) == 64, "The matrix file header must be 64 bytes long.");
+
+  /*!
+   * \brief Двоичный файл матрицы, отображенный в память только для чтения.
+   *
+   * Данные не читаются при открытии: страницы подгружаются операционной системой при первом обращении,
+   * поэтому загрузка матрицы ограничена скоростью диска, а не разбором текста.
+   */
+  struct MappedMatrixFile
+  {
+	MatrixFileHeader header {};
+	const unsigned char* view = nullptr;
+	size_t viewSize = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#else
+	int file = -1;
+#endif
+
+	MappedMatrixFile() = default;
+	MappedMatrixFile(const MappedMatrixFile&) = delete;
+	MappedMatrixFile& operator=(const MappedMatrixFile&) = delete;
+
+	~MappedMatrixFile()
+	{
+	  close();
+	}
+
+	/*!
+	 * \brief Отобразить файл в память. Возвращает false, если файл не открывается, заголовок неверен или данных не хватает.
+	 */
+	bool open(const std::string& path)
+	{
+	  close();
+
+#ifdef _WIN32
+	  file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	  LARGE_INTEGER fileSize;
+
+	  if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(header))
+	  {
+		close();
+		return false;
+	  }
+
+	  mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	  view = mapping != nullptr ? static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+	  viewSize = static_cast<size_t>(fileSize.QuadPart);
+#else
+	  struct stat fileStat;
+
+	  file = ::open(path.c_str(), O_RDONLY);
+
+	  if (file < 0 || fstat(file, &fileStat) != 0 || fileStat.st_size < (off_t)sizeof(header))
+	  {
+		close();
+		return false;
+	  }
+
+	  void* address = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_SHARED, file, 0);
+
+	  if (address != MAP_FAILED)
+	  {
+		view = static_cast<const unsigned char*>(address);
+		viewSize = static_cast<size_t>(fileStat.st_size);
+		// Файл читается последовательно, поэтому ядро может заранее подгружать следующие страницы
+		madvise(address, viewSize, MADV_SEQUENTIAL);
+	  }
+#endif
+
+	  if (view == nullptr)
+	  {
+		close();
+		return false;
+	  }
+
+	  std::memcpy(&header, view, sizeof(header));
+
+	  if (!header.isValid() || viewSize - sizeof(header) < header.getElementCount() * header.getElementSize())
+	  {
+		close();
+		return false;
+	  }
+
+	  return true;
+	}
+
+	void close()
+	{
+#ifdef _WIN32
+	  if (view != nullptr)
+	  {
+		UnmapViewOfFile(view);
+	  }
+	  if (mapping != nullptr)
+	  {
+		CloseHandle(mapping);
+	  }
+	  if (file != INVALID_HANDLE_VALUE)
+	  {
+		CloseHandle(file);
+	  }
+	  mapping = nullptr;
+	  file = INVALID_HANDLE_VALUE;
+#else
+	  if (view != nullptr)
+	  {
+		munmap(const_cast<unsigned char*>(view), viewSize);
+	  }
+	  if (file >= 0)
+	  {
+		::close(file);
+	  }
+	  file = -1;
+#endif
+	  view = nullptr;
+	  viewSize = 0;
+	}
+
+	/*!
+	 * \brief Данные матрицы в порядке блоков файла или nullptr, если тип элементов файла отличается от T.
+	 */
+	template<typename T>
+	const T* getData() const
+	{
+	  if (view == nullptr || header.elementKind != ElementKindOf<T>::value)
+	  {
+		return nullptr;
+	  }
+
+	  return reinterpret_cast<const T*>(view + sizeof(header));
+	}
+
+	/*!
+	 * \brief Скопировать count элементов строки rowIndex, начиная со столбца firstColumn, в target.
+	 *
+	 * Части строки, лежащие в одном блоке файла, копируются через memcpy.
+	 */
+	template<typename T>
+	void readRowSegment(size_t rowIndex, size_t firstColumn, size_t count, T* target) const
+	{
+	  const T* data = getData<T>();
+
+	  while (data != nullptr && count > 0)
+	  {
+		const size_t length = std::min<size_t>(count, header.blockWidth - firstColumn % header.blockWidth);
+
+		std::memcpy(target, data + header.getElementOffset(firstColumn, rowIndex), length * sizeof(T));
+		target += length;
+		firstColumn += length;
+		count -= length;
+	  }
+	}
+  };
+
+  /*!
+   * \brief Записать заголовок и данные матрицы (header.getElementCount() элементов в порядке блоков) одной операцией.
+   */
+  template<typename T>
+  bool writeMatrixFile(const std::string& path, const MatrixFileHeader& header, const T* data)
+  {
+	if (header.elementKind != ElementKindOf<T>::value || !header.isValid())
+	{
+	  return false;
+	}
+
+	std::ofstream file(path, std::ios::binary);
+
+	if (!file.is_open())
+	{
+	  return false;
+	}
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(header.getElementCount() * sizeof(T)));
+
+	return file.good();
+  }
+}
@@ -0,0 +1,982 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define MATRIX_KERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// GCC и Clang генерируют инструкции расширения только в функциях, помеченных атрибутом target,
+// MSVC позволяет использовать любые intrinsic-функции без дополнительных флагов
+#if defined(_MSC_VER) && !defined(__clang__)
+#define MATRIX_KERNELS_TARGET(extensions)
+#else
+#define MATRIX_KERNELS_TARGET(extensions) __attribute__((target(extensions)))
+#endif
+
+namespace matrix_kernels
+{
+  /*!
+   * \brief Параметры блочного умножения матриц.
+   *
+   * GEMM_MR x GEMM_NR - размер блока матрицы C, который накапливается в регистрах микроядра.
+   * GEMM_MC x GEMM_KC - размер упакованного блока матрицы A (должен помещаться в кэш L2).
+   * GEMM_KC x GEMM_NC - размер упакованной полосы матрицы B (должна помещаться в кэш L3).
+   */
+  constexpr size_t GEMM_MR = 6;
+  constexpr size_t GEMM_NR = 16;
+  constexpr size_t GEMM_MC = 96;
+  constexpr size_t GEMM_KC = 256;
+  constexpr size_t GEMM_NC = 2048;
+
+  /*!
+   * \brief Пустой обработчик прогресса умножения.
+   */
+  struct NoProgress
+  {
+	void operator()() const {}
+  };
+
+  /*!
+   * \brief Упаковать блок rows x depth матрицы A в полоски по GEMM_MR строк, недостающие строки заполняются нулями.
+   *
+   * Элемент (i, p) полоски r располагается по адресу packed[(r * depth + p) * GEMM_MR + i].
+   */
+  template<typename T>
+  void packA(const T* a, size_t lda, size_t rows, size_t depth, T* packed)
+  {
+	for (size_t r = 0; r < rows; r += GEMM_MR)
+	{
+	  const size_t mr = std::min(GEMM_MR, rows - r);
+
+	  for (size_t p = 0; p < depth; ++p)
+	  {
+		for (size_t i = 0; i < mr; ++i)
+		{
+		  packed[i] = a[(r + i) * lda + p];
+		}
+		for (size_t i = mr; i < GEMM_MR; ++i)
+		{
+		  packed[i] = 0;
+		}
+		packed += GEMM_MR;
+	  }
+	}
+  }
+
+  /*!
+   * \brief Упаковать блок depth x columns матрицы B в полоски по GEMM_NR столбцов, недостающие столбцы заполняются нулями.
+   *
+   * Элемент (p, j) полоски s располагается по адресу packed[(s * depth + p) * GEMM_NR + j].
+   */
+  template<typename T>
+  void packB(const T* b, size_t ldb, size_t depth, size_t columns, T* packed)
+  {
+	for (size_t s = 0; s < columns; s += GEMM_NR)
+	{
+	  const size_t nr = std::min(GEMM_NR, columns - s);
+
+	  for (size_t p = 0; p < depth; ++p)
+	  {
+		const T* row = b + p * ldb + s;
+
+		for (size_t j = 0; j < nr; ++j)
+		{
+		  packed[j] = row[j];
+		}
+		for (size_t j = nr; j < GEMM_NR; ++j)
+		{
+		  packed[j] = 0;
+		}
+		packed += GEMM_NR;
+	  }
+	}
+  }
+
+  /*!
+   * \brief Микроядро: C[mr x nr] += A[mr x depth] * B[depth x nr] для упакованных полосок A и B.
+   *
+   * Блок GEMM_MR x GEMM_NR матрицы C накапливается в локальном массиве, который компилятор размещает в регистрах.
+   */
+  template<typename T>
+  void microKernel(size_t depth, const T* __restrict packedA, const T* __restrict packedB, T* c, size_t ldc, size_t mr, size_t nr)
+  {
+	T accumulator[GEMM_MR][GEMM_NR] = {};
+
+	for (size_t p = 0; p < depth; ++p)
+	{
+	  for (size_t i = 0; i < GEMM_MR; ++i)
+	  {
+		const T value = packedA[i];
+
+		#pragma omp simd
+		for (size_t j = 0; j < GEMM_NR; ++j)
+		{
+		  accumulator[i][j] += value * packedB[j];
+		}
+	  }
+
+	  packedA += GEMM_MR;
+	  packedB += GEMM_NR;
+	}
+
+	for (size_t i = 0; i < mr; ++i)
+	{
+	  for (size_t j = 0; j < nr; ++j)
+	  {
+		c[i * ldc + j] += accumulator[i][j];
+	  }
+	}
+  }
+
+  /*!
+   * \brief Прибавить к блоку C[mr x nr] первые mr x nr элементов блока tile[GEMM_MR x GEMM_NR] (для неполных блоков на границах).
+   */
+  template<typename T>
+  void addTile(const T* tile, T* c, size_t ldc, size_t mr, size_t nr)
+  {
+	for (size_t i = 0; i < mr; ++i)
+	{
+	  for (size_t j = 0; j < nr; ++j)
+	  {
+		c[i * ldc + j] += tile[i * GEMM_NR + j];
+	  }
+	}
+  }
+
+  /*!
+   * \brief Набор векторных инструкций, используемый микроядром.
+   */
+  enum InstructionSet
+  {
+	SCALAR = 0,
+	SSE42 = 1,
+	AVX2 = 2,
+	AVX512 = 3
+  };
+
+  template<typename T>
+  using MicroKernel = void (*)(size_t depth, const T* packedA, const T* packedB, T* c, size_t ldc, size_t mr, size_t nr);
+
+#ifdef MATRIX_KERNELS_X86
+  inline void cpuid(int leaf, int subleaf, uint32_t registers[4])
+  {
+#if defined(_MSC_VER)
+	int values[4];
+	__cpuidex(values, leaf, subleaf);
+	for (int i = 0; i < 4; ++i)
+	{
+	  registers[i] = static_cast<uint32_t>(values[i]);
+	}
+#else
+	__cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+  }
+
+  inline uint64_t xgetbv()
+  {
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	uint32_t low, high;
+	__asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+	return (static_cast<uint64_t>(high) << 32) | low;
+#endif
+  }
+
+  /*!
+   * \brief Определить наилучший набор инструкций, поддерживаемый процессором и операционной системой.
+   *
+   * Для AVX2 и AVX-512 дополнительно проверяется (через XGETBV), что ОС сохраняет соответствующие регистры.
+   */
+  inline InstructionSet detectInstructionSet()
+  {
+	uint32_t registers[4];
+
+	cpuid(0, 0, registers);
+	const uint32_t maxLeaf = registers[0];
+
+	cpuid(1, 0, registers);
+	const bool sse42 = (registers[2] & (1u << 20)) != 0;
+	const bool fma = (registers[2] & (1u << 12)) != 0;
+	const bool osxsave = (registers[2] & (1u << 27)) != 0;
+	const bool avx = (registers[2] & (1u << 28)) != 0;
+
+	bool avx2 = false;
+	bool avx512 = false;
+
+	if (maxLeaf >= 7 && osxsave && avx)
+	{
+	  const uint64_t xcr0 = xgetbv();
+
+	  cpuid(7, 0, registers);
+	  avx2 = fma && (registers[1] & (1u << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+	  avx512 = avx2 && (registers[1] & (1u << 16)) != 0 && (xcr0 & 0xE6) == 0xE6;
+	}
+
+	if (avx512)
+	{
+	  return InstructionSet::AVX512;
+	}
+	if (avx2)
+	{
+	  return InstructionSet::AVX2;
+	}
+	if (sse42)
+	{
+	  return InstructionSet::SSE42;
+	}
+	return InstructionSet::SCALAR;
+  }
+
+  /*!
+   * \brief Микроядро SSE4.2 для float. Блок GEMM_MR x GEMM_NR обрабатывается двумя половинами по 8 столбцов,
+   * чтобы аккумуляторы помещались в 16 регистров xmm.
+   */
+  MATRIX_KERNELS_TARGET("sse4.2")
+  inline void microKernelSse42(size_t depth, const float* packedA, const float* packedB, float* c, size_t ldc, size_t mr, size_t nr)
+  {
+	alignas(64) float tile[GEMM_MR * GEMM_NR];
+	const bool full = mr == GEMM_MR && nr == GEMM_NR;
+
+	for (size_t half = 0; half < GEMM_NR; half += 8)
+	{
+	  __m128 accumulator[GEMM_MR][2];
+
+	  for (size_t i = 0; i < GEMM_MR; ++i)
+	  {
+		accumulator[i][0] = _mm_setzero_ps();
+		accumulator[i][1] = _mm_setzero_ps();
+	  }
+
+	  for (size_t p = 0; p < depth; ++p)
+	  {
+		const __m128 b0 = _mm_loadu_ps(packedB + p * GEMM_NR + half);
+		const __m128 b1 = _mm_loadu_ps(packedB + p * GEMM_NR + half + 4);
+
+		for (size_t i = 0; i < GEMM_MR; ++i)
+		{
+		  const __m128 a = _mm_set1_ps(packedA[p * GEMM_MR + i]);
+		  accumulator[i][0] = _mm_add_ps(accumulator[i][0], _mm_mul_ps(a, b0));
+		  accumulator[i][1] = _mm_add_ps(accumulator[i][1], _mm_mul_ps(a, b1));
+		}
+	  }
+
+	  for (size_t i = 0; i < GEMM_MR; ++i)
+	  {
+		for (size_t v = 0; v < 2; ++v)
+		{
+		  if (full)
+		  {
+			float* target = c + i * ldc + half + v * 4;
+			_mm_storeu_ps(target, _mm_add_ps(_mm_loadu_ps(target), accumulator[i][v]));
+		  }
+		  else
+		  {
+			_mm_store_ps(tile + i * GEMM_NR + half + v * 4, accumulator[i][v]);
+		  }
+		}
+	  }
+	}
+
+	if (!full)
+	{
+	  addTile(tile, c, ldc, mr, nr);
+	}
+  }
+
+  /*!
+   * \brief Микроядро SSE4.2 для int32 (умножение _mm_mullo_epi32 из SSE4.1).
+   */
+  MATRIX_KERNELS_TARGET("sse4.2")
+  inline void microKernelSse42(size_t depth, const int32_t* packedA, const int32_t* packedB, int32_t* c, size_t ldc, size_t mr, size_t nr)
+  {
+	alignas(64) int32_t tile[GEMM_MR * GEMM_NR];
+	const bool full = mr == GEMM_MR && nr == GEMM_NR;
+
+	for (size_t half = 0; half < GEMM_NR; half += 8)
+	{
+	  __m128i accumulator[GEMM_MR][2];
+
+	  for (size_t i = 0; i < GEMM_MR; ++i)
+	  {
+		accumulator[i][0] = _mm_setzero_si128();
+		accumulator[i][1] = _mm_setzero_si128();
+	  }
+
+	  for (size_t p = 0; p < depth; ++p)
+	  {
+		const __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(packedB + p * GEMM_NR + half));
+		const __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(packedB + p * GEMM_NR + half + 4));
+
+		for (size_t i = 0; i < GEMM_MR; ++i)
+		{
+		  const __m128i a = _mm_set1_epi32(packedA[p * GEMM_MR + i]);
+		  accumulator[i][0] = _mm_add_epi32(accumulator[i][0], _mm_mullo_epi32(a, b0));
+		  accumulator[i][1] = _mm_add_epi32(accumulator[i][1], _mm_mullo_epi32(a, b1));
+		}
+	  }
+
+	  for (size_t i = 0; i < GEMM_MR; ++i)
+	  {
+		for (size_t v = 0; v < 2; ++v)
+		{
+		  if (full)
+		  {
+			__m128i* target = reinterpret_cast<__m128i*>(c + i * ldc + half + v * 4);
+			_mm_storeu_si128(target, _mm_add_epi32(_mm_loadu_si128(target), accumulator[i][v]));
+		  }
+		  else
+		  {
+			_mm_store_si128(reinterpret_cast<__m128i*>(tile + i * GEMM_NR + half + v * 4), accumulator[i][v]);
+		  }
+		}
+	  }
+	}
+
+	if (!full)
+	{
+	  addTile(tile, c, ldc, mr, nr);
+	}
+  }
+
+  /*!
+   * \brief Микроядро AVX2 для float: 12 аккумуляторов ymm, умножение со сложением через FMA.
+   */
+  MATRIX_KERNELS_TARGET("avx2,fma")
+  inline void microKernelAvx2(size_t depth, const float* packedA, const float* packedB, float* c, size_t ldc, size_t mr, size_t nr)
+  {
+	__m256 accumulator[GEMM_MR][2];
+
+	for (size_t i = 0; i < GEMM_MR; ++i)
+	{
+	  accumulator[i][0] = _mm256_setzero_ps();
+	  accumulator[i][1] = _mm256_setzero_ps();
+	}
+
+	for (size_t p = 0; p < depth; ++p)
+	{
+	  const __m256 b0 = _mm256_loadu_ps(packedB);
+	  const __m256 b1 = _mm256_loadu_ps(packedB + 8);
+
+	  for (size_t i = 0; i < GEMM_MR; ++i)
+	  {
+		const __m256 a = _mm256_broadcast_ss(packedA + i);
+		accumulator[i][0] = _mm256_fmadd_ps(a, b0, accumulator[i][0]);
+		accumulator[i][1] = _mm256_fmadd_ps(a, b1, accumulator[i][1]);
+	  }
+
+	  packedA += GEMM_MR;
+	  packedB += GEMM_NR;
+	}
+
+	if (mr == GEMM_MR && nr == GEMM_NR)
+	{
+	  for (size_t i = 0; i < GEMM_MR; ++i)
+	  {
+		float* target = c + i * ldc;
+		_mm256_storeu_ps(target, _mm256_add_ps(_mm256_loadu_ps(target), accumulator[i][0]));
+		_mm256_storeu_ps(target + 8, _mm256_add_ps(_mm256_loadu_ps(target + 8), accumulator[i][1]));
+	  }
+	  return;
+	}
+
+	alignas(64) float tile[GEMM_MR * GEMM_NR];
+
+	for (size_t i = 0; i < GEMM_MR; ++i)
+	{
+	  _mm256_store_ps(tile + i * GEMM_NR, accumulator[i][0]);
+	  _mm256_store_ps(tile + i * GEMM_NR + 8, accumulator[i][1]);
+	}
+
+	addTile(tile, c, ldc, mr, nr);
+  }
+
+  /*!
+   * \brief Микроядро AVX2 для int32.
+   */
+  MATRIX_KERNELS_TARGET("avx2")
+  inline void microKernelAvx2(size_t depth, const int32_t* packedA, const int32_t* packedB, int32_t* c, size_t ldc, size_t mr, size_t nr)
+  {
+	__m256i accumulator[GEMM_MR][2];
+
+	for (size_t i = 0; i < GEMM_MR; ++i)
+	{
+	  accumulator[i][0] = _mm256_setzero_si256();
+	  accumulator[i][1] = _mm256_setzero_si256();
+	}
+
+	for (size_t p = 0; p < depth; ++p)
+	{
+	  const __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(packedB));
+	  const __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(packedB + 8));
+
+	  for (size_t i = 0; i < GEMM_MR; ++i)
+	  {
+		const __m256i a = _mm256_set1_epi32(packedA[i]);
+		accumulator[i][0] = _mm256_add_epi32(accumulator[i][0], _mm256_mullo_epi32(a, b0));
+		accumulator[i][1] = _mm256_add_epi32(accumulator[i][1], _mm256_mullo_epi32(a, b1));
+	  }
+
+	  packedA += GEMM_MR;
+	  packedB += GEMM_NR;
+	}
+
+	if (mr == GEMM_MR && nr == GEMM_NR)
+	{
+	  for (size_t i = 0; i < GEMM_MR; ++i)
+	  {
+		__m256i* target = reinterpret_cast<__m256i*>(c + i * ldc);
+		_mm256_storeu_si256(target, _mm256_add_epi32(_mm256_loadu_si256(target), accumulator[i][0]));
+		_mm256_storeu_si256(target + 1, _mm256_add_epi32(_mm256_loadu_si256(target + 1), accumulator[i][1]));
+	  }
+	  return;
+	}
+
+	alignas(64) int32_t tile[GEMM_MR * GEMM_NR];
+
+	for (size_t i = 0; i < GEMM_MR; ++i)
+	{
+	  _mm256_store_si256(reinterpret_cast<__m256i*>(tile + i * GEMM_NR), accumulator[i][0]);
+	  _mm256_store_si256(reinterpret_cast<__m256i*>(tile + i * GEMM_NR + 8), accumulator[i][1]);
+	}
+
+	addTile(tile, c, ldc, mr, nr);
+  }
+
+  /*!
+   * \brief Микроядро AVX-512 для float: одна строка блока C занимает один регистр zmm.
+   */
+  MATRIX_KERNELS_TARGET("avx512f")
+  inline void microKernelAvx512(size_t depth, const float* packedA, const float* packedB, float* c, size_t ldc, size_t mr, size_t nr)
+  {
+	__m512 accumulator[GEMM_MR];
+
+	for (size_t i = 0; i < GEMM_MR; ++i)
+	{
+	  accumulator[i] = _mm512_setzero_ps();
+	}
+
+	for (size_t p = 0; p < depth; ++p)
+	{
+	  const __m512 b = _mm512_loadu_ps(packedB);
+
+	  for (size_t i = 0; i < GEMM_MR; ++i)
+	  {
+		accumulator[i] = _mm512_fmadd_ps(_mm512_set1_ps(packedA[i]), b, accumulator[i]);
+	  }
+
+	  packedA += GEMM_MR;
+	  packedB += GEMM_NR;
+	}
+
+	// Неполные строки записываются по маске, лишние строки пропускаются
+	const __mmask16 mask = static_cast<__mmask16>((1u << nr) - 1);
+
+	for (size_t i = 0; i < mr; ++i)
+	{
+	  float* target = c + i * ldc;
+	  _mm512_mask_storeu_ps(target, mask, _mm512_add_ps(_mm512_maskz_loadu_ps(mask, target), accumulator[i]));
+	}
+  }
+
+  /*!
+   * \brief Микроядро AVX-512 для int32.
+   */
+  MATRIX_KERNELS_TARGET("avx512f")
+  inline void microKernelAvx512(size_t depth, const int32_t* packedA, const int32_t* packedB, int32_t* c, size_t ldc, size_t mr, size_t nr)
+  {
+	__m512i accumulator[GEMM_MR];
+
+	for (size_t i = 0; i < GEMM_MR; ++i)
+	{
+	  accumulator[i] = _mm512_setzero_si512();
+	}
+
+	for (size_t p = 0; p < depth; ++p)
+	{
+	  const __m512i b = _mm512_loadu_si512(packedB);
+
+	  for (size_t i = 0; i < GEMM_MR; ++i)
+	  {
+		accumulator[i] = _mm512_add_epi32(accumulator[i], _mm512_mullo_epi32(_mm512_set1_epi32(packedA[i]), b));
+	  }
+
+	  packedA += GEMM_MR;
+	  packedB += GEMM_NR;
+	}
+
+	const __mmask16 mask = static_cast<__mmask16>((1u << nr) - 1);
+
+	for (size_t i = 0; i < mr; ++i)
+	{
+	  int32_t* target = c + i * ldc;
+	  _mm512_mask_storeu_epi32(target, mask, _mm512_add_epi32(_mm512_maskz_loadu_epi32(mask, target), accumulator[i]));
+	}
+  }
+#else
+  inline InstructionSet detectInstructionSet()
+  {
+	return InstructionSet::SCALAR;
+  }
+#endif
+
+  /*!
+   * \brief Выбрать микроядро для заданного набора инструкций. Для типов без векторных ядер используется переносимое ядро.
+   */
+  template<typename T>
+  MicroKernel<T> selectMicroKernel(InstructionSet)
+  {
+	return &microKernel<T>;
+  }
+
+#ifdef MATRIX_KERNELS_X86
+  template<>
+  inline MicroKernel<float> selectMicroKernel<float>(InstructionSet instructionSet)
+  {
+	switch (instructionSet)
+	{
+	case InstructionSet::AVX512:
+	  return &microKernelAvx512;
+	case InstructionSet::AVX2:
+	  return &microKernelAvx2;
+	case InstructionSet::SSE42:
+	  return &microKernelSse42;
+	default:
+	  return &microKernel<float>;
+	}
+  }
+
+  template<>
+  inline MicroKernel<int32_t> selectMicroKernel<int32_t>(InstructionSet instructionSet)
+  {
+	switch (instructionSet)
+	{
+	case InstructionSet::AVX512:
+	  return &microKernelAvx512;
+	case InstructionSet::AVX2:
+	  return &microKernelAvx2;
+	case InstructionSet::SSE42:
+	  return &microKernelSse42;
+	default:
+	  return &microKernel<int32_t>;
+	}
+  }
+#endif
+
+  /*!
+   * \brief Набор инструкций, выбранный при первом обращении по результатам cpuid.
+   */
+  inline InstructionSet getInstructionSet()
+  {
+	static const InstructionSet instructionSet = detectInstructionSet();
+	return instructionSet;
+  }
+
+  inline const char* getInstructionSetName(InstructionSet instructionSet)
+  {
+	switch (instructionSet)
+	{
+	case InstructionSet::AVX512:
+	  return "AVX-512";
+	case InstructionSet::AVX2:
+	  return "AVX2";
+	case InstructionSet::SSE42:
+	  return "SSE4.2";
+	default:
+	  return "scalar";
+	}
+  }
+
+  /*!
+   * \brief Умножение упакованного блока A[mc x kc] на упакованную полосу B[kc x nc] с накоплением в C.
+   */
+  template<typename T>
+  void macroKernel(MicroKernel<T> kernel, const T* packedA, const T* packedB, T* c, size_t ldc, size_t mc, size_t nc, size_t kc)
+  {
+	for (size_t jr = 0; jr < nc; jr += GEMM_NR)
+	{
+	  for (size_t ir = 0; ir < mc; ir += GEMM_MR)
+	  {
+		kernel(kc, packedA + ir * kc, packedB + jr * kc, c + ir * ldc + jr, ldc, std::min(GEMM_MR, mc - ir), std::min(GEMM_NR, nc - jr));
+	  }
+	}
+  }
+
+  /*!
+   * \brief Блочное умножение матриц с накоплением: C[m x n] += A[m x k] * B[k x n].
+   *
+   * Матрицы хранятся по строкам, lda, ldb и ldc - расстояния между началами соседних строк в элементах.
+   * Полоса B размером GEMM_KC x GEMM_NC и блок A размером GEMM_MC x GEMM_KC упаковываются в непрерывные буферы,
+   * после чего блоки GEMM_MR x GEMM_NR матрицы C вычисляются микроядром.
+   *
+   * Микроядро выбирается один раз по набору инструкций процессора (см. getInstructionSet).
+   *
+   * \param progress Функтор, вызываемый после обработки каждого блока строк A (например, для продвижения обменов)
+   */
+  template<typename T, typename Progress = NoProgress>
+  void multiplyAdd(const T* a, const T* b, T* c, size_t m, size_t n, size_t k, size_t lda, size_t ldb, size_t ldc,
+	Progress progress = Progress())
+  {
+	static const MicroKernel<T> kernel = selectMicroKernel<T>(getInstructionSet());
+	const size_t roundedMc = (std::min(GEMM_MC, m) + GEMM_MR - 1) / GEMM_MR * GEMM_MR;
+	const size_t roundedNc = (std::min(GEMM_NC, n) + GEMM_NR - 1) / GEMM_NR * GEMM_NR;
+	std::vector<T> packedA(roundedMc * std::min(GEMM_KC, k));
+	std::vector<T> packedB(std::min(GEMM_KC, k) * roundedNc);
+
+	for (size_t jc = 0; jc < n; jc += GEMM_NC)
+	{
+	  const size_t nc = std::min(GEMM_NC, n - jc);
+
+	  for (size_t pc = 0; pc < k; pc += GEMM_KC)
+	  {
+		const size_t kc = std::min(GEMM_KC, k - pc);
+
+		packB(b + pc * ldb + jc, ldb, kc, nc, packedB.data());
+
+		for (size_t ic = 0; ic < m; ic += GEMM_MC)
+		{
+		  const size_t mc = std::min(GEMM_MC, m - ic);
+
+		  packA(a + ic * lda + pc, lda, mc, kc, packedA.data());
+		  macroKernel(kernel, packedA.data(), packedB.data(), c + ic * ldc + jc, ldc, mc, nc, kc);
+
+		  progress();
+		}
+	  }
+	}
+  }
+
+  /*!
+   * \brief Многопоточное блочное умножение матриц с накоплением: C[m x n] += A[m x k] * B[k x n].
+   *
+   * Вызывается вне параллельной области, умножение выполняет команда OpenMP из threads потоков (0 - omp_get_max_threads).
+   * Потоки совместно упаковывают полосу B, затем каждый поток упаковывает свои блоки A и вычисляет
+   * соответствующие им строки C, поэтому записи в C не пересекаются. Без OpenMP функция выполняется последовательно.
+   *
+   * \param progress Функтор, вызываемый главным потоком команды после каждого обработанного им блока строк A
+   * (например, для продвижения обменов MPI в режиме MPI_THREAD_FUNNELED)
+   */
+  template<typename T, typename Progress = NoProgress>
+  void multiplyAddParallel(const T* a, const T* b, T* c, size_t m, size_t n, size_t k, size_t lda, size_t ldb, size_t ldc,
+	int threads = 0, Progress progress = Progress())
+  {
+	static const MicroKernel<T> kernel = selectMicroKernel<T>(getInstructionSet());
+	const size_t roundedMc = (std::min(GEMM_MC, m) + GEMM_MR - 1) / GEMM_MR * GEMM_MR;
+	const size_t roundedNc = (std::min(GEMM_NC, n) + GEMM_NR - 1) / GEMM_NR * GEMM_NR;
+	std::vector<T> packedB(std::min(GEMM_KC, k) * roundedNc);
+	const int rowBlocks = static_cast<int>((m + GEMM_MC - 1) / GEMM_MC);
+
+#ifdef _OPENMP
+	if (threads <= 0)
+	{
+	  threads = omp_get_max_threads();
+	}
+#endif
+
+	#pragma omp parallel num_threads(threads)
+	{
+	  std::vector<T> packedA(roundedMc * std::min(GEMM_KC, k));
+
+	  for (size_t jc = 0; jc < n; jc += GEMM_NC)
+	  {
+		const size_t nc = std::min(GEMM_NC, n - jc);
+
+		for (size_t pc = 0; pc < k; pc += GEMM_KC)
+		{
+		  const size_t kc = std::min(GEMM_KC, k - pc);
+		  const int slivers = static_cast<int>((nc + GEMM_NR - 1) / GEMM_NR);
+
+		  #pragma omp for
+		  for (int s = 0; s < slivers; ++s)
+		  {
+			const size_t column = static_cast<size_t>(s) * GEMM_NR;
+			packB(b + pc * ldb + jc + column, ldb, kc, std::min(GEMM_NR, nc - column), packedB.data() + column * kc);
+		  }
+
+		  #pragma omp for schedule(dynamic)
+		  for (int block = 0; block < rowBlocks; ++block)
+		  {
+			const size_t ic = static_cast<size_t>(block) * GEMM_MC;
+			const size_t mc = std::min(GEMM_MC, m - ic);
+
+			packA(a + ic * lda + pc, lda, mc, kc, packedA.data());
+			macroKernel(kernel, packedA.data(), packedB.data(), c + ic * ldc + jc, ldc, mc, nc, kc);
+
+#ifdef _OPENMP
+			if (omp_get_thread_num() == 0)
+#endif
+			{
+			  progress();
+			}
+		  }
+		}
+	  }
+	}
+  }
+
+  /*!
+   * \brief Блочное умножение квадратных матриц с накоплением: C += A * B, матрицы size x size хранятся по строкам подряд.
+   */
+  template<typename T, typename Progress = NoProgress>
+  void multiplyAdd(const T* a, const T* b, T* c, size_t size, Progress progress = Progress())
+  {
+	multiplyAdd(a, b, c, size, size, size, size, size, size, progress);
+  }
+
+  /*!
+   * \brief Параметры алгоритма Штрассена-Винограда.
+   *
+   * STRASSEN_CUTOFF - размер, начиная с которого (и меньше) подматрицы умножаются блочным алгоритмом.
+   * STRASSEN_TASK_LEVELS - число верхних уровней рекурсии, на которых произведения выполняются задачами OpenMP.
+   */
+  constexpr size_t STRASSEN_CUTOFF = 2048;
+  constexpr int STRASSEN_TASK_LEVELS = 2;
+
+  /*!
+   * \brief Суммы блоков A для алгоритма Штрассена-Винограда:
+   * S1 = A21 + A22, S2 = S1 - A11, S3 = A11 - A21, S4 = A12 - S2 (результаты хранятся по строкам подряд).
+   */
+  template<typename T>
+  void strassenSumsA(const T* a11, const T* a12, const T* a21, const T* a22, size_t lda, size_t rows, size_t columns,
+	T* s1, T* s2, T* s3, T* s4)
+  {
+	for (size_t i = 0; i < rows; ++i)
+	{
+	  for (size_t j = 0; j < columns; ++j)
+	  {
+		const size_t source = i * lda + j;
+		const size_t target = i * columns + j;
+
+		s1[target] = a21[source] + a22[source];
+		s2[target] = s1[target] - a11[source];
+		s3[target] = a11[source] - a21[source];
+		s4[target] = a12[source] - s2[target];
+	  }
+	}
+  }
+
+  /*!
+   * \brief Разности блоков B для алгоритма Штрассена-Винограда:
+   * T1 = B12 - B11, T2 = B22 - T1, T3 = B22 - B12, T4 = B21 - T2 (последняя со знаком минус по сравнению с классической записью).
+   */
+  template<typename T>
+  void strassenSumsB(const T* b11, const T* b12, const T* b21, const T* b22, size_t ldb, size_t rows, size_t columns,
+	T* t1, T* t2, T* t3, T* t4)
+  {
+	for (size_t i = 0; i < rows; ++i)
+	{
+	  for (size_t j = 0; j < columns; ++j)
+	  {
+		const size_t source = i * ldb + j;
+		const size_t target = i * columns + j;
+
+		t1[target] = b12[source] - b11[source];
+		t2[target] = b22[source] - t1[target];
+		t3[target] = b22[source] - b12[source];
+		t4[target] = b21[source] - t2[target];
+	  }
+	}
+  }
+
+  /*!
+   * \brief Рекурсивный шаг алгоритма Штрассена-Винограда: C[m x n] += A[m x k] * B[k x n].
+   *
+   * Из семи произведений половинных блоков M2, M3 и M4 прибавляются сразу к разным четвертям C,
+   * а M1, M5, M6 и M7 вычисляются во временные матрицы и складываются после завершения всех произведений.
+   * На верхних STRASSEN_TASK_LEVELS уровнях произведения и сложения выполняются задачами OpenMP.
+   */
+  template<typename T, typename Progress>
+  void strassenMultiplyAdd(const T* a, const T* b, T* c, size_t m, size_t n, size_t k, size_t lda, size_t ldb, size_t ldc,
+	size_t cutoff, int level, Progress& progress)
+  {
+	if (m <= cutoff || n <= cutoff || k <= cutoff)
+	{
+	  multiplyAdd(a, b, c, m, n, k, lda, ldb, ldc, [&progress]()
+		{
+#ifdef _OPENMP
+		  if (omp_get_thread_num() == 0)
+#endif
+		  {
+			progress();
+		  }
+		});
+	  return;
+	}
+
+	// Для нечетных размеров алгоритм применяется к четной части, а последние строка, столбец
+	// и слой общей размерности досчитываются блочным алгоритмом
+	const size_t evenM = m & ~static_cast<size_t>(1);
+	const size_t evenN = n & ~static_cast<size_t>(1);
+	const size_t evenK = k & ~static_cast<size_t>(1);
+
+	if (evenM != m || evenN != n || evenK != k)
+	{
+	  strassenMultiplyAdd(a, b, c, evenM, evenN, evenK, lda, ldb, ldc, cutoff, level, progress);
+
+	  if (evenK != k)
+	  {
+		multiplyAdd(a + evenK, b + evenK * ldb, c, evenM, evenN, 1, lda, ldb, ldc);
+	  }
+	  if (evenN != n)
+	  {
+		multiplyAdd(a, b + evenN, c + evenN, evenM, 1, k, lda, ldb, ldc);
+	  }
+	  if (evenM != m)
+	  {
+		multiplyAdd(a + evenM * lda, b, c + evenM * ldc, 1, n, k, lda, ldb, ldc);
+	  }
+	  return;
+	}
+
+	const size_t hm = m / 2;
+	const size_t hn = n / 2;
+	const size_t hk = k / 2;
+	const T* a11 = a;
+	const T* a12 = a + hk;
+	const T* a21 = a + hm * lda;
+	const T* a22 = a21 + hk;
+	const T* b11 = b;
+	const T* b12 = b + hn;
+	const T* b21 = b + hk * ldb;
+	const T* b22 = b21 + hn;
+	T* c11 = c;
+	T* c12 = c + hn;
+	T* c21 = c + hm * ldc;
+	T* c22 = c21 + hn;
+	const bool useTasks = level < STRASSEN_TASK_LEVELS;
+
+	std::vector<T> m1(hm * hn), m5(hm * hn), m6(hm * hn), m7(hm * hn);
+
+	{
+	  std::vector<T> s1(hm * hk), s2(hm * hk), s3(hm * hk), s4(hm * hk);
+	  std::vector<T> t1(hk * hn), t2(hk * hn), t3(hk * hn), t4(hk * hn);
+
+	  #pragma omp task default(shared) if(useTasks)
+	  strassenSumsA(a11, a12, a21, a22, lda, hm, hk, s1.data(), s2.data(), s3.data(), s4.data());
+	  #pragma omp task default(shared) if(useTasks)
+	  strassenSumsB(b11, b12, b21, b22, ldb, hk, hn, t1.data(), t2.data(), t3.data(), t4.data());
+	  #pragma omp taskwait
+
+	  // M1 = A11 * B11, M2 = A12 * B21, M3 = S4 * B22, M4 = A22 * T4, M5 = S1 * T1, M6 = S2 * T2, M7 = S3 * T3
+	  #pragma omp task default(shared) if(useTasks)
+	  strassenMultiplyAdd(a11, b11, m1.data(), hm, hn, hk, lda, ldb, hn, cutoff, level + 1, progress);
+	  #pragma omp task default(shared) if(useTasks)
+	  strassenMultiplyAdd(a12, b21, c11, hm, hn, hk, lda, ldb, ldc, cutoff, level + 1, progress);
+	  #pragma omp task default(shared) if(useTasks)
+	  strassenMultiplyAdd(s4.data(), b22, c12, hm, hn, hk, hk, ldb, ldc, cutoff, level + 1, progress);
+	  #pragma omp task default(shared) if(useTasks)
+	  strassenMultiplyAdd(a22, t4.data(), c21, hm, hn, hk, lda, hn, ldc, cutoff, level + 1, progress);
+	  #pragma omp task default(shared) if(useTasks)
+	  strassenMultiplyAdd(s1.data(), t1.data(), m5.data(), hm, hn, hk, hk, hn, hn, cutoff, level + 1, progress);
+	  #pragma omp task default(shared) if(useTasks)
+	  strassenMultiplyAdd(s2.data(), t2.data(), m6.data(), hm, hn, hk, hk, hn, hn, cutoff, level + 1, progress);
+	  #pragma omp task default(shared) if(useTasks)
+	  strassenMultiplyAdd(s3.data(), t3.data(), m7.data(), hm, hn, hk, hk, hn, hn, cutoff, level + 1, progress);
+	  #pragma omp taskwait
+	}
+
+	// C11 += M1, C12 += M1 + M6 + M5, C21 += M1 + M6 + M7, C22 += M1 + M6 + M7 + M5
+	// (M2, M3 и M4 уже прибавлены к C11, C12 и C21)
+	#pragma omp task default(shared) if(useTasks)
+	for (size_t i = 0; i < hm; ++i)
+	{
+	  for (size_t j = 0; j < hn; ++j)
+	  {
+		c11[i * ldc + j] += m1[i * hn + j];
+	  }
+	}
+	#pragma omp task default(shared) if(useTasks)
+	for (size_t i = 0; i < hm; ++i)
+	{
+	  for (size_t j = 0; j < hn; ++j)
+	  {
+		c12[i * ldc + j] += m1[i * hn + j] + m6[i * hn + j] + m5[i * hn + j];
+	  }
+	}
+	#pragma omp task default(shared) if(useTasks)
+	for (size_t i = 0; i < hm; ++i)
+	{
+	  for (size_t j = 0; j < hn; ++j)
+	  {
+		c21[i * ldc + j] += m1[i * hn + j] + m6[i * hn + j] + m7[i * hn + j];
+	  }
+	}
+	#pragma omp task default(shared) if(useTasks)
+	for (size_t i = 0; i < hm; ++i)
+	{
+	  for (size_t j = 0; j < hn; ++j)
+	  {
+		c22[i * ldc + j] += m1[i * hn + j] + m6[i * hn + j] + m7[i * hn + j] + m5[i * hn + j];
+	  }
+	}
+	#pragma omp taskwait
+  }
+
+  /*!
+   * \brief Умножение матриц с накоплением по алгоритму Штрассена-Винограда: C[m x n] += A[m x k] * B[k x n].
+   *
+   * Рекурсия делит матрицы пополам, пока все размеры больше cutoff, после чего подматрицы умножаются
+   * блочным алгоритмом (multiplyAdd). Алгоритм выполняет 7 умножений половинных блоков вместо 8 и выигрывает
+   * у блочного на больших матрицах, но требует дополнительной памяти (около трех размеров C на верхнем уровне
+   * и больше при параллельном выполнении) и менее точен для чисел с плавающей точкой (см. strassenErrorBound).
+   *
+   * Вызывается вне параллельной области, задачи выполняет команда OpenMP из threads потоков (0 - omp_get_max_threads).
+   *
+   * \param progress Функтор, вызываемый главным потоком команды после каждого обработанного им блока строк A
+   */
+  template<typename T, typename Progress = NoProgress>
+  void multiplyAddStrassen(const T* a, const T* b, T* c, size_t m, size_t n, size_t k, size_t lda, size_t ldb, size_t ldc,
+	size_t cutoff = STRASSEN_CUTOFF, int threads = 0, Progress progress = Progress())
+  {
+	cutoff = std::max<size_t>(cutoff, 1);
+
+#ifdef _OPENMP
+	if (threads <= 0)
+	{
+	  threads = omp_get_max_threads();
+	}
+#endif
+
+	#pragma omp parallel num_threads(threads)
+	#pragma omp single
+	strassenMultiplyAdd(a, b, c, m, n, k, lda, ldb, ldc, cutoff, 0, progress);
+  }
+
+  /*!
+   * \brief Оценка сверху погрешности алгоритма Штрассена-Винограда для квадратных матриц size x size
+   * в норме max|x_ij| (Higham, Accuracy and Stability of Numerical Algorithms, 23.2.2):
+   * |C - C'| <= [(n / n0)^log2(18) * (n0^2 + 6 * n0) - 6 * n] * u * |A| * |B|,
+   * где n0 - размер подматриц, умножаемых блочным алгоритмом, u - единица округления типа T.
+   */
+  template<typename T>
+  double strassenErrorBound(size_t size, size_t cutoff, double maxA, double maxB)
+  {
+	size_t leafSize = size;
+
+	while (leafSize > std::max<size_t>(cutoff, 1))
+	{
+	  leafSize /= 2;
+	}
+
+	const double n = static_cast<double>(size);
+	const double n0 = static_cast<double>(leafSize);
+	const double unitRoundoff = std::numeric_limits<T>::epsilon() / 2;
+
+	return (std::pow(n / n0, std::log2(18.0)) * (n0 * n0 + 6 * n0) - 6 * n) * unitRoundoff * maxA * maxB;
+  }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+namespace matrix_random
+{
+  /*!
+   * \brief Перемешивающая функция генератора SplitMix64: биективно отображает 64-битное число в псевдослучайное.
+   */
+  inline uint64_t mix64(uint64_t value)
+  {
+	value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+	return value ^ (value >> 31);
+  }
+
+  /*!
+   * \brief Счетчиковый генератор: index-е число последовательности SplitMix64 с зерном seed.
+   *
+   * Значение зависит только от зерна и номера, поэтому любые части последовательности можно вычислять
+   * независимо и в любом порядке (в разных потоках и процессах), без общего состояния.
+   */
+  inline uint64_t getRandomValue(uint64_t seed, uint64_t index)
+  {
+	const uint64_t gamma = 0x9E3779B97F4A7C15ULL;
+
+	return mix64(mix64(seed) + (index + 1) * gamma);
+  }
+
+  /*!
+   * \brief Элемент (columnIndex, rowIndex) случайной матрицы шириной width с зерном seed (от 0 до 99).
+   */
+  template<typename T>
+  T getMatrixElement(uint64_t seed, size_t width, size_t columnIndex, size_t rowIndex)
+  {
+	return static_cast<T>(getRandomValue(seed, static_cast<uint64_t>(rowIndex) * width + columnIndex) % 100);
+  }
+
+  /*!
+   * \brief Сгенерировать часть rows x columns случайной матрицы width x height, начинающуюся со строки firstRow
+   * и столбца firstColumn, в буфер target с расстоянием между строками stride.
+   *
+   * Элементы вне матрицы (дополнение блоков) не изменяются. Строки генерируются командой OpenMP, если функция
+   * вызвана вне параллельной области. Результат не зависит ни от разбиения матрицы на части, ни от числа потоков.
+   */
+  template<typename T>
+  void generateMatrixPart(uint64_t seed, size_t width, size_t height, size_t firstRow, size_t firstColumn, size_t rows,
+	size_t columns, T* target, size_t stride)
+  {
+	const int rowCount = static_cast<int>(firstRow < height ? std::min(rows, height - firstRow) : 0);
+	const size_t columnCount = firstColumn < width ? std::min(columns, width - firstColumn) : 0;
+
+	#pragma omp parallel for
+	for (int y = 0; y < rowCount; ++y)
+	{
+	  T* row = target + y * stride;
+
+	  for (size_t x = 0; x < columnCount; ++x)
+	  {
+		row[x] = getMatrixElement<T>(seed, width, firstColumn + x, firstRow + y);
+	  }
+	}
+  }
+}
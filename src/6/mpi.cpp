@@ -1,301 +1,788 @@
 #include <iostream>
 #include <fstream>
+#include <string>
+#include <vector>
+#include <numeric>
+#include <cmath>
+#include <cstring>
 #include <mpi.h>
+#include <omp.h>
+
+#include "matrix-kernels.h"
+#include "matrix-file.h"
+#include "matrix-random.h"
 
 
 using ElementType = int;
 
 
 struct Submatrix {
-	size_t size = 0;
+	size_t width = 0;
+	size_t height = 0;
 	ElementType* data = nullptr;
 
-	Submatrix(size_t size) {
-		this->size = size;
-		this->data = new ElementType[size * size];
+	Submatrix(size_t width, size_t height) {
+		this->width = width;
+		this->height = height;
+		this->data = new ElementType[width * height];
 
-		for (size_t i = 0; i < size * size; ++i) {
+		for (size_t i = 0; i < width * height; ++i) {
 			this->data[i] = 0;
 		}
 	}
 
+	Submatrix(size_t size) : Submatrix(size, size) {
+	}
+
 	~Submatrix() {
 		delete[] data;
 	}
 
 	ElementType& getValue(size_t columnIndex, size_t rowIndex) {
-		if (rowIndex >= size || columnIndex >= size) {
+#ifndef NDEBUG
+		if (rowIndex >= height || columnIndex >= width) {
 			throw std::exception("Invalid indexes.");
 		}
-		return *(data + rowIndex * size + columnIndex);
+#endif
+		return data[rowIndex * width + columnIndex];
+	}
+
+	ElementType* getRow(size_t rowIndex) {
+		return data + rowIndex * width;
 	}
 };
 
 
+// Матрица width x height, разбитая на blockColumns x blockRows блоков размером blockWidth x blockHeight.
+// Блоки хранятся подряд в одном буфере (блок (x, y) имеет номер x * blockRows + y), поэтому матрицу можно
+// целиком передать в MPI_Scatterv/MPI_Gatherv. Если размер матрицы не делится на число блоков, блоки дополняются нулями.
 struct Matrix {
-	size_t blockCount = 0;
-	size_t blockSize = 0;
-	Submatrix** blocks = nullptr;
+	size_t width = 0;
+	size_t height = 0;
+	size_t blockColumns = 0;
+	size_t blockRows = 0;
+	size_t blockWidth = 0;
+	size_t blockHeight = 0;
+	ElementType* data = nullptr;
 
-	Matrix(size_t blockCount, size_t blockSize) {
-		this->blockCount = blockCount;
-		this->blockSize = blockSize;
-		this->blocks = new Submatrix * [blockCount * blockCount];
+	Matrix(size_t width, size_t height, size_t blockColumns, size_t blockRows, size_t blockWidth, size_t blockHeight) {
+		this->width = width;
+		this->height = height;
+		this->blockColumns = blockColumns;
+		this->blockRows = blockRows;
+		this->blockWidth = blockWidth;
+		this->blockHeight = blockHeight;
+		this->data = new ElementType[blockColumns * blockRows * blockWidth * blockHeight];
 
-		for (size_t i = 0; i < blockCount * blockCount; ++i) {
-			this->blocks[i] = new Submatrix(blockSize);
+		for (size_t i = 0; i < blockColumns * blockRows * blockWidth * blockHeight; ++i) {
+			this->data[i] = 0;
 		}
 	}
 
 	~Matrix() {
-		for (size_t i = 0; i < blockCount * blockCount; ++i) {
-			delete blocks[i];
-		}
-
-		delete[] blocks;
+		delete[] data;
 	}
 
-	Submatrix* getBlock(size_t rowIndex, size_t columnIndex) {
-		if (rowIndex >= blockCount || columnIndex >= blockCount) {
+	ElementType* getBlock(size_t columnIndex, size_t rowIndex) {
+#ifndef NDEBUG
+		if (rowIndex >= blockRows || columnIndex >= blockColumns) {
 			throw std::exception("Invalid indexes.");
 		}
-		return *(blocks + rowIndex * blockCount + columnIndex);
+#endif
+		return data + (columnIndex * blockRows + rowIndex) * blockWidth * blockHeight;
 	}
 
-	ElementType& getValue(size_t columnIndex, size_t rowIndex) {
-		return getBlock(columnIndex / blockSize, rowIndex / blockSize)
-			->getValue(columnIndex % blockSize, rowIndex % blockSize);
+	ElementType* getRowSegment(size_t rowIndex, size_t blockIndex) {
+		return getBlock(blockIndex, rowIndex / blockHeight) + (rowIndex % blockHeight) * blockWidth;
 	}
-};
 
+	// Число элементов матрицы (без дополнения) в части строки, лежащей в блоке с горизонтальным номером blockIndex
+	size_t getSegmentWidth(size_t blockIndex) const {
+		return blockIndex * blockWidth >= width ? 0 : std::min(blockWidth, width - blockIndex * blockWidth);
+	}
 
-void readMatrixFromFile(Matrix& matrix, const std::string& path) {
-	std::ifstream file(path);
+	ElementType& getValue(size_t columnIndex, size_t rowIndex) {
+		return getRowSegment(rowIndex, columnIndex / blockWidth)[columnIndex % blockWidth];
+	}
 
-	if (file.is_open()) {
-		size_t matrixSize = matrix.blockCount * matrix.blockSize;
+	// Заголовок двоичного файла с той же разбивкой на блоки: такой файл загружается одним копированием
+	matrix_file::MatrixFileHeader getFileHeader() const {
+		return matrix_file::MatrixFileHeader(matrix_file::ElementKindOf<ElementType>::value, width, height, blockColumns,
+			blockRows, blockWidth, blockHeight);
+	}
+};
 
-		for (size_t y = 0; y < matrixSize; ++y) {
-			for (size_t x = 0; x < matrixSize; ++x) {
-				ElementType value;
 
-				file >> value;
+// Загрузить матрицу из двоичного файла (см. matrix-file.h). Если разбивка файла на блоки совпадает с разбивкой матрицы,
+// данные копируются одним блоком, иначе - частями строк. Возвращает false, если файл не открывается или не подходит матрице
+bool readMatrixFromFile(Matrix& matrix, const std::string& path) {
+	matrix_file::MappedMatrixFile file;
 
-				matrix.getValue(x, y) = value;
+	if (!file.open(path) || file.getData<ElementType>() == nullptr || file.header.width != matrix.width
+		|| file.header.height != matrix.height) {
+		return false;
+	}
+
+	if (file.header.hasSameLayout(matrix.getFileHeader())) {
+		std::memcpy(matrix.data, file.getData<ElementType>(), file.header.getElementCount() * sizeof(ElementType));
+	}
+	else {
+		for (size_t y = 0; y < matrix.height; ++y) {
+			for (size_t block = 0; block < matrix.blockColumns; ++block) {
+				file.readRowSegment(y, block * matrix.blockWidth, matrix.getSegmentWidth(block), matrix.getRowSegment(y, block));
 			}
 		}
 	}
 
-	file.close();
+	return true;
+}
+
+// Сохранить матрицу в двоичный файл вместе с разбивкой на блоки
+bool saveMatrixToFile(Matrix& matrix, const std::string& path) {
+	return matrix_file::writeMatrixFile(path, matrix.getFileHeader(), matrix.data);
 }
 
-void saveMatrixToFile(Matrix& matrix, const std::string& path) {
-	std::ofstream file(path);
+size_t divideRoundUp(size_t value, size_t divisor) {
+	return (value + divisor - 1) / divisor;
+}
 
-	if (file.is_open()) {
-		size_t matrixSize = matrix.blockCount * matrix.blockSize;
+// Смещения блоков процессов решетки в буфере матрицы (в блоках): процесс с координатами (x, y) владеет блоком (x, y)
+std::vector<int> getBlockDisplacements(MPI_Comm gridCommutator) {
+	int processNumber, dimensions[2], periods[2], coords[2];
 
-		for (size_t y = 0; y < matrixSize; ++y) {
-			for (size_t x = 0; x < matrixSize; ++x) {
-				file << matrix.getValue(x, y) << " ";
-			}
-			file << "\n";
-		}
+	MPI_Comm_size(gridCommutator, &processNumber);
+	MPI_Cart_get(gridCommutator, 2, dimensions, periods, coords);
+
+	std::vector<int> displacements(processNumber);
+
+	for (int rank = 0; rank < processNumber; ++rank) {
+		MPI_Cart_coords(gridCommutator, rank, 2, coords);
+		displacements[rank] = coords[0] * dimensions[1] + coords[1];
 	}
 
-	file.close();
+	return displacements;
 }
 
-void generateMatrix(Matrix& matrix) {
-	srand(time(nullptr));
-	size_t matrixSize = matrix.blockCount * matrix.blockSize;
-
-	for (size_t y = 0; y < matrixSize; ++y) {
-		for (size_t x = 0; x < matrixSize; ++x) {
-			matrix.getValue(x, y) = rand() % 100;
-		}
-	}
+// Сгенерировать блок (blockColumn, blockRow) случайной матрицы width x height (см. matrix-random.h).
+// Блок (x, y) содержит строки, начиная с y * block.height, и столбцы, начиная с x * block.width
+void generateBlock(Submatrix& block, uint64_t seed, size_t width, size_t height, size_t blockColumn, size_t blockRow) {
+	matrix_random::generateMatrixPart(seed, width, height, blockRow * block.height, blockColumn * block.width, block.height,
+		block.width, block.data, block.width);
 }
 
-int main(int argc, char** argv) {
-	const bool outputMatrix = false;
-	const size_t matrixSize = 4096;
-	const size_t blockCount = 2;
-	const size_t blockSize = matrixSize / blockCount;
+// Собрать блоки процессов решетки сразу на свои места в матрице (matrix используется только в процессе 0)
+void gatherMatrix(Submatrix& block, Matrix* matrix, MPI_Comm gridCommutator) {
 	int processNumber, processRank;
+	MPI_Datatype blockType;
 
-	MPI_Init(&argc, &argv);
-	MPI_Comm_size(MPI_COMM_WORLD, &processNumber);
-	MPI_Comm_rank(MPI_COMM_WORLD, &processRank);
+	MPI_Comm_size(gridCommutator, &processNumber);
+	MPI_Comm_rank(gridCommutator, &processRank);
+	MPI_Type_contiguous(block.width * block.height, MPI_INT, &blockType);
+	MPI_Type_commit(&blockType);
 
-	if (blockCount * blockCount != processNumber || matrixSize % blockCount != 0) {
-		if (processRank == 0) {
-			std::cerr << "The number of blocks must be equal to the number of processes, and the size of the matrix must be a multiple of the number of blocks in a row/column.";
-		}
+	std::vector<int> counts(processNumber, 1);
+	std::vector<int> displacements = getBlockDisplacements(gridCommutator);
 
-		MPI_Finalize();
-		return 0;
+	MPI_Gatherv(block.data, 1, blockType, processRank == 0 ? matrix->data : nullptr, counts.data(), displacements.data(),
+		blockType, 0, gridCommutator);
+
+	MPI_Type_free(&blockType);
+}
+
+// Прочитать заголовок двоичного файла матрицы (см. matrix-file.h) во всех процессах коммуникатора.
+// Возвращает false, если файл не открывается, заголовок неверен, тип элементов другой или данных не хватает
+bool readMatrixFileHeader(const std::string& path, matrix_file::MatrixFileHeader& header, MPI_Comm commutator) {
+	MPI_File file;
+	MPI_Offset fileSize;
+
+	if (MPI_File_open(commutator, path.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+		return false;
 	}
 
-	MPI_Status status;
-	MPI_Comm matrixBlockCommutator;
-	int dimensions[2] = { blockCount, blockCount };
-	int periods[2] = { 1, 1 };
-	int coords[2] = { 0, 0 };
+	MPI_File_get_size(file, &fileSize);
+	MPI_File_read_at_all(file, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+	MPI_File_close(&file);
+
+	return header.isValid() && header.elementKind == matrix_file::ElementKindOf<ElementType>::value
+		&& static_cast<uint64_t>(fileSize) >= sizeof(header) + header.getElementCount() * sizeof(ElementType);
+}
 
-	MPI_Cart_create(MPI_COMM_WORLD, 2, dimensions, periods, 1, &matrixBlockCommutator);
-	MPI_Cart_coords(matrixBlockCommutator, processRank, 2, coords);
+// Типы MPI для части блока процесса, лежащей внутри матрицы: fileType выделяет ее в матрице fileWidth x fileHeight,
+// хранящейся по строкам, memoryType - в буфере блока (blockColumn, blockRow). Блок (x, y) содержит строки, начиная
+// с y * block.height, и столбцы, начиная с x * block.width. Возвращает false, если блок состоит только из дополнения
+bool createBlockTypes(Submatrix& block, size_t width, size_t height, size_t fileWidth, size_t fileHeight, size_t blockColumn,
+	size_t blockRow, MPI_Datatype& fileType, MPI_Datatype& memoryType) {
+	const size_t firstColumn = blockColumn * block.width;
+	const size_t firstRow = blockRow * block.height;
 
-	Submatrix* blockA = nullptr;
-	Submatrix* blockB = nullptr;
-	Submatrix* blockC = nullptr;
-	double startTime;
+	if (firstColumn >= width || firstRow >= height) {
+		return false;
+	}
 
-	if (processRank == 0) {
-		Matrix matrixA(blockCount, blockSize);
-		Matrix matrixB(blockCount, blockSize);
+	int fileSizes[2] = { static_cast<int>(fileHeight), static_cast<int>(fileWidth) };
+	int blockSizes[2] = { static_cast<int>(block.height), static_cast<int>(block.width) };
+	int subsizes[2] = { static_cast<int>(std::min(block.height, height - firstRow)), static_cast<int>(std::min(block.width, width - firstColumn)) };
+	int fileStarts[2] = { static_cast<int>(firstRow), static_cast<int>(firstColumn) };
+	int blockStarts[2] = { 0, 0 };
 
-		generateMatrix(matrixA);
-		generateMatrix(matrixB);
-		//readMatrixFromFile(matrixA, "matrix6_6.txt");
-		//readMatrixFromFile(matrixB, "matrix6_6.txt");
+	MPI_Type_create_subarray(2, fileSizes, subsizes, fileStarts, MPI_ORDER_C, MPI_INT, &fileType);
+	MPI_Type_create_subarray(2, blockSizes, subsizes, blockStarts, MPI_ORDER_C, MPI_INT, &memoryType);
+	MPI_Type_commit(&fileType);
+	MPI_Type_commit(&memoryType);
 
-		startTime = MPI_Wtime();
+	return true;
+}
 
-		for (size_t y = 0; y < blockCount; ++y) {
-			for (size_t x = 0; x < blockCount; ++x) {
-				if (x != 0 || y != 0) {
-					int rank;
-					int coords[2] = { x, y };
+// Каждый процесс решетки читает свой блок матрицы из двоичного файла коллективной операцией MPI-IO, поэтому ни один
+// процесс не хранит матрицу целиком. Файл с той же разбивкой на блоки, что и у решетки, читается непрерывными кусками,
+// файл по строкам (из одного блока) - через тип-подмассив. Другие разбивки не поддерживаются (возвращается false).
+// Процесс читает блок (blockColumn, blockRow), не обязательно совпадающий с его координатами в решетке
+bool readMatrixBlock(const std::string& path, const matrix_file::MatrixFileHeader& header, Submatrix& block,
+	size_t blockColumn, size_t blockRow, MPI_Comm gridCommutator) {
+	int dimensions[2], periods[2], coords[2];
 
-					MPI_Cart_rank(matrixBlockCommutator, coords, &rank);
-					MPI_Send(matrixA.getBlock(x, y)->data, blockSize * blockSize, MPI_INT, rank, 0, MPI_COMM_WORLD);
-					MPI_Send(matrixB.getBlock(x, y)->data, blockSize * blockSize, MPI_INT, rank, 0, MPI_COMM_WORLD);
-				}
-			}
-		}
+	MPI_Cart_get(gridCommutator, 2, dimensions, periods, coords);
+
+	const matrix_file::MatrixFileHeader gridLayout(matrix_file::ElementKindOf<ElementType>::value, header.width, header.height,
+		dimensions[0], dimensions[1], block.width, block.height);
+	const bool sameLayout = header.hasSameLayout(gridLayout);
+
+	if (!sameLayout && (header.blockColumns != 1 || header.blockRows != 1)) {
+		return false;
+	}
 
-		blockA = new Submatrix(blockSize);
-		blockB = new Submatrix(blockSize);
-		blockC = new Submatrix(blockSize);
+	MPI_File file;
 
-		memcpy(blockA->data, matrixA.getBlock(0, 0)->data, blockSize * blockSize * sizeof(ElementType));
-		memcpy(blockB->data, matrixB.getBlock(0, 0)->data, blockSize * blockSize * sizeof(ElementType));
+	if (MPI_File_open(gridCommutator, path.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+		return false;
+	}
+
+	if (sameLayout) {
+		const MPI_Offset blockOffset = sizeof(header) + (static_cast<MPI_Offset>(blockColumn) * dimensions[1] + blockRow)
+			* block.width * block.height * sizeof(ElementType);
+
+		MPI_File_read_at_all(file, blockOffset, block.data, block.width * block.height, MPI_INT, MPI_STATUS_IGNORE);
 	}
 	else {
-		blockA = new Submatrix(blockSize);
-		blockB = new Submatrix(blockSize);
-		blockC = new Submatrix(blockSize);
+		MPI_Datatype fileType, memoryType;
+		const bool hasData = createBlockTypes(block, header.width, header.height, header.blockWidth, header.blockHeight,
+			blockColumn, blockRow, fileType, memoryType);
 
-		MPI_Recv(blockA->data, blockSize * blockSize, MPI_INT, 0, 0, MPI_COMM_WORLD, &status);
-		MPI_Recv(blockB->data, blockSize * blockSize, MPI_INT, 0, 0, MPI_COMM_WORLD, &status);
+		// Процесс, блок которого состоит только из дополнения, читает 0 элементов, но участвует в коллективной операции
+		MPI_File_set_view(file, sizeof(header), MPI_INT, hasData ? fileType : MPI_INT, "native", MPI_INFO_NULL);
+		MPI_File_read_at_all(file, 0, block.data, hasData ? 1 : 0, hasData ? memoryType : MPI_INT, MPI_STATUS_IGNORE);
+
+		if (hasData) {
+			MPI_Type_free(&fileType);
+			MPI_Type_free(&memoryType);
+		}
 	}
 
-	{
-		int source, dest;
-		ElementType* tempData = new ElementType[blockSize * blockSize];
+	MPI_File_close(&file);
+	return true;
+}
+
+// Каждый процесс решетки записывает свой блок матрицы width x height в двоичный файл по строкам коллективной
+// операцией MPI-IO (заголовок записывает процесс 0), поэтому матрица не собирается в одном процессе
+bool writeMatrixBlock(const std::string& path, Submatrix& block, size_t width, size_t height, MPI_Comm gridCommutator) {
+	int processRank, dimensions[2], periods[2], coords[2];
+	MPI_File file;
+
+	MPI_Comm_rank(gridCommutator, &processRank);
+	MPI_Cart_get(gridCommutator, 2, dimensions, periods, coords);
+
+	if (MPI_File_open(gridCommutator, path.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+		return false;
+	}
 
-		MPI_Cart_shift(matrixBlockCommutator, 0, -coords[1], &source, &dest);
-		MPI_Sendrecv(blockA->data, blockSize * blockSize, MPI_INT, dest, 0, tempData, blockSize * blockSize, MPI_INT, source, 0, MPI_COMM_WORLD, &status);
-		memcpy(blockA->data, tempData, blockSize * blockSize * sizeof(ElementType));
+	const matrix_file::MatrixFileHeader header(matrix_file::ElementKindOf<ElementType>::value, width, height, 1, 1, width, height);
+	MPI_Datatype fileType, memoryType;
+	const bool hasData = createBlockTypes(block, width, height, width, height, coords[0], coords[1], fileType,
+		memoryType);
 
-		delete[] tempData;
+	MPI_File_set_size(file, sizeof(header) + header.getElementCount() * sizeof(ElementType));
+
+	if (processRank == 0) {
+		MPI_File_write_at(file, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+	}
+
+	MPI_File_set_view(file, sizeof(header), MPI_INT, hasData ? fileType : MPI_INT, "native", MPI_INFO_NULL);
+	MPI_File_write_at_all(file, 0, block.data, hasData ? 1 : 0, hasData ? memoryType : MPI_INT, MPI_STATUS_IGNORE);
+	MPI_File_close(&file);
+
+	if (hasData) {
+		MPI_Type_free(&fileType);
+		MPI_Type_free(&memoryType);
 	}
 
-	{
+	return true;
+}
+
+// Алгоритм Кэннона на квадратной периодической решетке: блоки A сдвигаются по строкам, блоки B - по столбцам.
+// Блоки могут быть прямоугольными (матрицы произвольной формы), но решетка должна быть квадратной.
+// Выполняются шаги firstStep, ..., firstStep + stepCount - 1 (по умолчанию все шаги): начальный сдвиг учитывает
+// firstStep, поэтому в алгоритме 2.5D каждый слой вычисляет свою часть суммы. Если alignedBlocks, процесс (x, y) уже
+// хранит блоки A ((x + y + firstStep) mod q, y) и B (x, (x + y + firstStep) mod q), и начальный сдвиг не выполняется.
+// Если все размеры блоков больше strassenCutoff (0 - не использовать), блоки умножаются алгоритмом Штрассена-Винограда
+void multiplyCannon(Submatrix& blockA, Submatrix& blockB, Submatrix& blockC, MPI_Comm gridCommutator, int multiplyThreads,
+	size_t strassenCutoff, size_t firstStep = 0, size_t stepCount = 0, bool alignedBlocks = false) {
+	int dimensions[2], periods[2], coords[2];
+
+	MPI_Cart_get(gridCommutator, 2, dimensions, periods, coords);
+
+	const size_t blockCount = stepCount != 0 ? stepCount : dimensions[0];
+	const int sizeA = blockA.width * blockA.height;
+	const int sizeB = blockB.width * blockB.height;
+	const bool useStrassen = strassenCutoff != 0 && std::min({ blockC.height, blockC.width, blockA.width }) > strassenCutoff;
+	MPI_Status status;
+
+	// Буферы приема при сдвиге блоков: после получения данных меняются местами с буферами блоков,
+	// поэтому сдвиги не требуют ни выделения памяти, ни копирования
+	ElementType* shiftBufferA = new ElementType[sizeA];
+	ElementType* shiftBufferB = new ElementType[sizeB];
+
+	if (!alignedBlocks) {
 		int source, dest;
-		ElementType* tempData = new ElementType[blockSize * blockSize];
 
-		MPI_Cart_shift(matrixBlockCommutator, 1, -coords[0], &source, &dest);
-		MPI_Sendrecv(blockB->data, blockSize * blockSize, MPI_INT, dest, 1, tempData, blockSize * blockSize, MPI_INT, source, 1, MPI_COMM_WORLD, &status);
-		memcpy(blockB->data, tempData, blockSize * blockSize * sizeof(ElementType));
+		MPI_Cart_shift(gridCommutator, 0, -(coords[1] + static_cast<int>(firstStep)), &source, &dest);
+		MPI_Sendrecv(blockA.data, sizeA, MPI_INT, dest, 0, shiftBufferA, sizeA, MPI_INT, source, 0, gridCommutator, &status);
+		std::swap(blockA.data, shiftBufferA);
 
-		delete[] tempData;
+		MPI_Cart_shift(gridCommutator, 1, -(coords[0] + static_cast<int>(firstStep)), &source, &dest);
+		MPI_Sendrecv(blockB.data, sizeB, MPI_INT, dest, 1, shiftBufferB, sizeB, MPI_INT, source, 1, gridCommutator, &status);
+		std::swap(blockB.data, shiftBufferB);
 	}
 
+	int sourceA, destA, sourceB, destB;
+
+	MPI_Cart_shift(gridCommutator, 0, -1, &sourceA, &destA);
+	MPI_Cart_shift(gridCommutator, 1, -1, &sourceB, &destB);
+
 	for (size_t q = 0; q < blockCount; ++q) {
-		for (size_t y = 0; y < blockSize; ++y) {
-			for (size_t x = 0; x < blockSize; ++x) {
-				ElementType value = 0;
+		// Сдвиг блоков для следующей итерации выполняется во время умножения текущих блоков
+		const bool shiftBlocks = q + 1 < blockCount;
+		MPI_Request requests[4];
+		int completed = 0;
+
+		if (shiftBlocks) {
+			MPI_Irecv(shiftBufferA, sizeA, MPI_INT, sourceA, 0, gridCommutator, &requests[0]);
+			MPI_Isend(blockA.data, sizeA, MPI_INT, destA, 0, gridCommutator, &requests[1]);
+			MPI_Irecv(shiftBufferB, sizeB, MPI_INT, sourceB, 1, gridCommutator, &requests[2]);
+			MPI_Isend(blockB.data, sizeB, MPI_INT, destB, 1, gridCommutator, &requests[3]);
+		}
+
+		// Главный поток периодически продвигает обмены, пока команда OpenMP умножает блоки
+		auto progress = [&]() {
+			if (shiftBlocks && !completed) {
+				MPI_Testall(4, requests, &completed, MPI_STATUSES_IGNORE);
+			}
+		};
+
+		if (useStrassen) {
+			matrix_kernels::multiplyAddStrassen(blockA.data, blockB.data, blockC.data, blockC.height, blockC.width, blockA.width,
+				blockA.width, blockB.width, blockC.width, strassenCutoff, multiplyThreads, progress);
+		}
+		else {
+			matrix_kernels::multiplyAddParallel(blockA.data, blockB.data, blockC.data, blockC.height, blockC.width, blockA.width,
+				blockA.width, blockB.width, blockC.width, multiplyThreads, progress);
+		}
+
+		if (shiftBlocks) {
+			MPI_Waitall(4, requests, MPI_STATUSES_IGNORE);
+			std::swap(blockA.data, shiftBufferA);
+			std::swap(blockB.data, shiftBufferB);
+		}
+	}
+
+	delete[] shiftBufferA;
+	delete[] shiftBufferB;
+}
 
-				for (size_t i = 0; i < blockSize; ++i) {
-					value += blockA->getValue(i, y) * blockB->getValue(x, i);
+// Алгоритм SUMMA на решетке произвольной формы. Общая размерность делится на полосы шириной panelWidth;
+// на каждом шаге владельцы полосы A и полосы B рассылают их по строке и по столбцу решетки,
+// после чего каждый процесс прибавляет произведение полос к своему блоку C.
+// Рассылки конвейеризованы: пока умножаются полосы текущего шага, неблокирующие MPI_Ibcast передают полосы
+// следующего шага во второй комплект буферов
+void multiplySumma(Submatrix& blockA, Submatrix& blockB, Submatrix& blockC, size_t panelWidth, MPI_Comm gridCommutator,
+	int multiplyThreads) {
+	int dimensions[2], periods[2], coords[2];
+	int rowDimensions[2] = { 1, 0 };
+	int columnDimensions[2] = { 0, 1 };
+	MPI_Comm rowCommutator, columnCommutator;
+	MPI_Datatype panelTypeA;
+
+	MPI_Cart_get(gridCommutator, 2, dimensions, periods, coords);
+	// Ранг процесса в коммуникаторе строки равен coords[0], в коммуникаторе столбца - coords[1]
+	MPI_Cart_sub(gridCommutator, rowDimensions, &rowCommutator);
+	MPI_Cart_sub(gridCommutator, columnDimensions, &columnCommutator);
+
+	// Полоса A в блоке владельца - panelWidth столбцов из каждой строки блока
+	MPI_Type_vector(blockA.height, panelWidth, blockA.width, MPI_INT, &panelTypeA);
+	MPI_Type_commit(&panelTypeA);
+
+	const size_t panelCount = blockA.width * dimensions[0] / panelWidth;
+	std::vector<ElementType> panelBuffersA[2];
+	std::vector<ElementType> panelBuffersB[2];
+	ElementType* panelsA[2];
+	ElementType* panelsB[2];
+	size_t panelStridesA[2];
+	MPI_Request requests[2][2];
+
+	for (int slot = 0; slot < 2; ++slot) {
+		panelBuffersA[slot].resize(panelWidth * blockA.height);
+		panelBuffersB[slot].resize(panelWidth * blockB.width);
+	}
+
+	// Начать рассылку полосы panel в комплект буферов slot. Владельцы рассылают полосы прямо из своих блоков
+	auto startBroadcast = [&](size_t panel, int slot) {
+		const size_t k = panel * panelWidth;
+		const int ownerColumn = k / blockA.width;
+		const int ownerRow = k / blockB.height;
+
+		if (coords[0] == ownerColumn) {
+			panelsA[slot] = blockA.data + k % blockA.width;
+			panelStridesA[slot] = blockA.width;
+			MPI_Ibcast(panelsA[slot], 1, panelTypeA, ownerColumn, rowCommutator, &requests[slot][0]);
+		}
+		else {
+			panelsA[slot] = panelBuffersA[slot].data();
+			panelStridesA[slot] = panelWidth;
+			MPI_Ibcast(panelsA[slot], panelWidth * blockA.height, MPI_INT, ownerColumn, rowCommutator, &requests[slot][0]);
+		}
+
+		panelsB[slot] = coords[1] == ownerRow ? blockB.data + (k % blockB.height) * blockB.width : panelBuffersB[slot].data();
+		MPI_Ibcast(panelsB[slot], panelWidth * blockB.width, MPI_INT, ownerRow, columnCommutator, &requests[slot][1]);
+	};
+
+	startBroadcast(0, 0);
+
+	for (size_t panel = 0; panel < panelCount; ++panel) {
+		const int slot = panel % 2;
+		const bool prefetch = panel + 1 < panelCount;
+		int completed = 0;
+
+		MPI_Waitall(2, requests[slot], MPI_STATUSES_IGNORE);
+
+		// Буферы второго комплекта освободились после умножения на предыдущем шаге
+		if (prefetch) {
+			startBroadcast(panel + 1, 1 - slot);
+		}
+
+		matrix_kernels::multiplyAddParallel(panelsA[slot], panelsB[slot], blockC.data, blockC.height, blockC.width, panelWidth,
+			panelStridesA[slot], blockB.width, blockC.width, multiplyThreads, [&]() {
+				if (prefetch && !completed) {
+					MPI_Testall(2, requests[1 - slot], &completed, MPI_STATUSES_IGNORE);
 				}
+			});
+	}
 
-				blockC->getValue(x, y) += value;
-			}
+	MPI_Type_free(&panelTypeA);
+	MPI_Comm_free(&rowCommutator);
+	MPI_Comm_free(&columnCommutator);
+}
+
+// Разобрать размеры матриц: "N" (квадратные матрицы N x N) или "MxKxN" (A - M x K, B - K x N)
+bool parseMatrixSizes(const char* argument, size_t sizes[3]) {
+	char* end = nullptr;
+	long long values[3];
+	int count = 0;
+
+	while (count < 3) {
+		values[count] = std::strtoll(argument, &end, 10);
+
+		if (end == argument || values[count] <= 0) {
+			return false;
 		}
 
-		{
-			int source, dest;
-			ElementType* tempData = new ElementType[blockSize * blockSize];
+		++count;
+
+		if (*end != 'x') {
+			break;
+		}
+
+		argument = end + 1;
+	}
+
+	if (*end != '\0' || (count != 1 && count != 3)) {
+		return false;
+	}
+
+	for (int i = 0; i < 3; ++i) {
+		sizes[i] = count == 1 ? values[0] : values[i];
+	}
 
-			MPI_Cart_shift(matrixBlockCommutator, 0, -1, &source, &dest);
-			MPI_Sendrecv(blockA->data, blockSize * blockSize, MPI_INT, dest, 0, tempData, blockSize * blockSize, MPI_INT, source, 0, MPI_COMM_WORLD, &status);
-			memcpy(blockA->data, tempData, blockSize * blockSize * sizeof(ElementType));
+	return true;
+}
+
+int main(int argc, char** argv) {
+	const bool outputMatrix = false;
+	// Число потоков OpenMP, умножающих блок внутри процесса (0 - OMP_NUM_THREADS или число ядер).
+	// Гибридный режим позволяет запускать один процесс на сокет и использовать все его ядра.
+	const int threadsPerProcess = 0;
+	// Порог алгоритма Штрассена-Винограда для умножения блоков в алгоритмах Кэннона и 2.5D
+	// (0 - классическое блочное умножение, иначе рекурсия продолжается, пока размеры блоков больше порога)
+	const size_t strassenCutoff = 0;
+	// В алгоритмах Кэннона и 2.5D каждый процесс сразу генерирует (читает) блоки, которые он получил бы после
+	// начального сдвига, поэтому ни раздачи, ни начального сдвига, ни копирования блоков по глубине не требуется
+	const bool alignBlocksOnInput = true;
+	int processNumber, processRank, threadSupport;
+
+	// MPI вызывается только из главного потока, потоки OpenMP работают лишь внутри умножения блоков
+	MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &threadSupport);
+	MPI_Comm_size(MPI_COMM_WORLD, &processNumber);
+	MPI_Comm_rank(MPI_COMM_WORLD, &processRank);
 
-			delete[] tempData;
+	// Зерно генератора матриц: A генерируется с зерном matrixSeed, B - с зерном matrixSeed + 1
+	const uint64_t matrixSeed = 2024;
+
+	// Желаемая ширина полосы SUMMA: полос должно быть достаточно много, чтобы рассылки перекрывались с вычислениями
+	const size_t targetPanelWidth = 256;
+
+	// Аргументы командной строки: размеры матриц ("N" или "MxKxN", по умолчанию 4096), алгоритм
+	// (auto, cannon, summa, 2.5d), число реплик для алгоритма 2.5D (по умолчанию 2), двоичные файлы матриц A и B
+	// (тогда размеры берутся из их заголовков, а первый аргумент не используется) и файл для результата C.
+	// Файлы читаются и записываются по блокам всеми процессами через MPI-IO, иначе каждый процесс генерирует свои
+	// блоки A и B, а C собирается в процессе 0 только для вывода (outputMatrix)
+	size_t sizes[3] = { 4096, 4096, 4096 };
+	std::string algorithm = argc > 2 ? argv[2] : "auto";
+	const int replicas = argc > 3 ? std::atoi(argv[3]) : 2;
+	const std::string pathA = argc > 5 ? argv[4] : "";
+	const std::string pathB = argc > 5 ? argv[5] : "";
+	const std::string pathC = argc > 6 ? argv[6] : "";
+	matrix_file::MatrixFileHeader headerA, headerB;
+
+	if ((argc > 1 && pathA.empty() && !parseMatrixSizes(argv[1], sizes))
+		|| (algorithm != "auto" && algorithm != "cannon" && algorithm != "summa" && algorithm != "2.5d") || replicas <= 0
+		|| argc == 5 || argc > 7) {
+		if (processRank == 0) {
+			std::cerr << "Usage: " << argv[0] << " [N | MxKxN] [auto | cannon | summa | 2.5d] [replicas] [A.bin B.bin [C.bin]]\n";
 		}
 
-		{
-			int source, dest;
-			ElementType* tempData = new ElementType[blockSize * blockSize];
+		MPI_Finalize();
+		return 0;
+	}
 
-			MPI_Cart_shift(matrixBlockCommutator, 1, -1, &source, &dest);
-			MPI_Sendrecv(blockB->data, blockSize * blockSize, MPI_INT, dest, 0, tempData, blockSize * blockSize, MPI_INT, source, 0, MPI_COMM_WORLD, &status);
-			memcpy(blockB->data, tempData, blockSize * blockSize * sizeof(ElementType));
+	if (!pathA.empty()) {
+		if (!readMatrixFileHeader(pathA, headerA, MPI_COMM_WORLD) || !readMatrixFileHeader(pathB, headerB, MPI_COMM_WORLD)
+			|| headerA.width != headerB.height) {
+			if (processRank == 0) {
+				std::cerr << "The input files are not readable or the matrices cannot be multiplied.\n";
+			}
 
-			delete[] tempData;
+			MPI_Finalize();
+			return 0;
 		}
+
+		sizes[0] = headerA.height;
+		sizes[1] = headerA.width;
+		sizes[2] = headerB.width;
 	}
 
-	Matrix* matrixC = nullptr;
+	// A - matrixRows x matrixInner, B - matrixInner x matrixColumns, C - matrixRows x matrixColumns
+	const size_t matrixRows = sizes[0];
+	const size_t matrixInner = sizes[1];
+	const size_t matrixColumns = sizes[2];
+	const int multiplyThreads = threadSupport >= MPI_THREAD_FUNNELED ? threadsPerProcess : 1;
 
-	if (processRank == 0) {
-		matrixC = new Matrix(blockCount, blockSize);
+	if (threadSupport < MPI_THREAD_FUNNELED && processRank == 0) {
+		std::cerr << "MPI_THREAD_FUNNELED is not supported, blocks are multiplied by a single thread.\n";
 	}
 
-	{
-		ElementType* recvBuffer = nullptr;
+	// Алгоритм 2.5D использует решетку q x q x replicas: каждый слой хранит копию блоков A и B,
+	// выполняет q / replicas шагов алгоритма Кэннона, после чего частичные суммы C складываются по глубине
+	const int layerSize = static_cast<int>(std::lround(std::sqrt(static_cast<double>(processNumber / replicas))));
 
+	if (algorithm == "2.5d" && (layerSize * layerSize * replicas != processNumber || replicas > layerSize)) {
 		if (processRank == 0) {
-			recvBuffer = new ElementType[matrixSize * matrixSize];
+			std::cerr << "The 2.5D algorithm requires q * q * replicas processes with replicas <= q, auto is used instead.\n";
 		}
 
-		MPI_Gather(blockC->data, blockSize * blockSize, MPI_INT, recvBuffer, blockSize * blockSize, MPI_INT, 0, MPI_COMM_WORLD);
+		algorithm = "auto";
+	}
+
+	// Решетка (слой) процессов максимально близка к квадратной. Алгоритм Кэннона требует квадратной решетки, поэтому
+	// если число процессов - не точный квадрат, используется SUMMA и в умножении участвуют все процессы.
+	// Координата 0 решетки - номер столбца блоков, координата 1 - номер строки блоков.
+	MPI_Comm gridCommutator;
+	MPI_Comm depthCommutator = MPI_COMM_NULL;
+	int dimensions[2] = { 0, 0 };
+	int periods[2] = { 1, 1 };
+	int layer = 0;
+
+	if (algorithm == "2.5d") {
+		MPI_Comm cubeCommutator;
+		int cubeDimensions[3] = { layerSize, layerSize, replicas };
+		int cubePeriods[3] = { 1, 1, 0 };
+		int cubeCoords[3];
+		int layerDimensions[3] = { 1, 1, 0 };
+		int depthDimensions[3] = { 0, 0, 1 };
+
+		MPI_Cart_create(MPI_COMM_WORLD, 3, cubeDimensions, cubePeriods, 1, &cubeCommutator);
+		MPI_Comm_rank(cubeCommutator, &processRank);
+		MPI_Cart_coords(cubeCommutator, processRank, 3, cubeCoords);
+		MPI_Cart_sub(cubeCommutator, layerDimensions, &gridCommutator);
+		MPI_Cart_sub(cubeCommutator, depthDimensions, &depthCommutator);
+		MPI_Comm_free(&cubeCommutator);
+
+		layer = cubeCoords[2];
+		dimensions[0] = layerSize;
+		dimensions[1] = layerSize;
+	}
+	else {
+		MPI_Dims_create(processNumber, 2, dimensions);
+		MPI_Cart_create(MPI_COMM_WORLD, 2, dimensions, periods, 1, &gridCommutator);
+		MPI_Comm_rank(gridCommutator, &processRank);
+	}
 
+	const size_t gridColumns = dimensions[0];
+	const size_t gridRows = dimensions[1];
+
+	if (algorithm == "auto") {
+		algorithm = gridColumns == gridRows ? "cannon" : "summa";
+	}
+	else if (algorithm == "cannon" && gridColumns != gridRows) {
 		if (processRank == 0) {
-			for (size_t x = 0; x < blockCount; ++x) {
-				for (size_t y = 0; y < blockCount; ++y) {
-					memcpy(matrixC->getBlock(x, y)->data,
-						recvBuffer + x * blockSize * blockSize * blockCount + y * blockSize * blockSize,
-						blockSize * blockSize * sizeof(ElementType));
-				}
+			std::cerr << "Cannon's algorithm requires a square number of processes, SUMMA is used instead.\n";
+		}
+
+		algorithm = "summa";
+	}
+
+	// Размеры блоков округляются вверх, матрицы дополняются нулями. Число полос общей размерности кратно
+	// НОК(gridColumns, gridRows), чтобы каждая полоса SUMMA целиком лежала в блоке одного процесса
+	const size_t panelUnit = std::lcm(gridColumns, gridRows);
+	const size_t panelCount = panelUnit * std::max<size_t>(1, divideRoundUp(matrixInner, panelUnit * targetPanelWidth));
+	const size_t panelWidth = divideRoundUp(matrixInner, panelCount);
+	const size_t innerSize = panelWidth * panelCount;
+	const size_t blockWidth = divideRoundUp(matrixColumns, gridColumns);
+	const size_t blockHeight = divideRoundUp(matrixRows, gridRows);
+
+	Submatrix blockA(innerSize / gridColumns, blockHeight);
+	Submatrix blockB(blockWidth, innerSize / gridRows);
+	Submatrix blockC(blockWidth, blockHeight);
+	double startTime;
+
+	if (processRank == 0) {
+		std::cout << "Algorithm: " << algorithm << ", process grid: " << gridRows << "x" << gridColumns;
+		if (depthCommutator != MPI_COMM_NULL) {
+			std::cout << "x" << replicas;
+		}
+		std::cout << ", matrix sizes: " << matrixRows << "x" << matrixInner << "x" << matrixColumns << "\n";
+	}
+
+	const bool alignedBlocks = alignBlocksOnInput && algorithm != "summa";
+	const size_t firstStep = algorithm == "2.5d" ? layer * gridColumns / replicas : 0;
+	const size_t lastStep = algorithm == "2.5d" ? (layer + 1) * gridColumns / replicas : gridColumns;
+	int gridRank, coords[2];
+
+	MPI_Comm_rank(gridCommutator, &gridRank);
+	MPI_Cart_coords(gridCommutator, gridRank, 2, coords);
+
+	// Номера блоков A и B, которые хранит процесс перед умножением: свои или уже сдвинутые, как в начале алгоритма Кэннона
+	const size_t columnA = alignedBlocks ? (coords[0] + coords[1] + firstStep) % gridColumns : coords[0];
+	const size_t rowB = alignedBlocks ? (coords[1] + coords[0] + firstStep) % gridRows : coords[1];
+
+	// Без входных файлов каждый процесс (во всех слоях 2.5D) сам генерирует свои блоки A и B: элементы зависят
+	// только от зерна и положения в матрице, поэтому матрицы не зависят от числа процессов и не раздаются
+	if (pathA.empty()) {
+		generateBlock(blockA, matrixSeed, matrixInner, matrixRows, columnA, coords[1]);
+		generateBlock(blockB, matrixSeed + 1, matrixColumns, matrixInner, coords[0], rowB);
+	}
+	// Блоки из файлов читаются процессами слоя 0 и копируются в остальные слои, а уже сдвинутые блоки
+	// различаются по слоям, поэтому их читает каждый слой
+	else {
+		if ((alignedBlocks || layer == 0) && (!readMatrixBlock(pathA, headerA, blockA, columnA, coords[1], gridCommutator)
+			|| !readMatrixBlock(pathB, headerB, blockB, coords[0], rowB, gridCommutator))) {
+			if (processRank == 0) {
+				std::cerr << "The input files must be stored by rows or split into blocks like the process grid.\n";
 			}
 
-			delete[] recvBuffer;
+			MPI_Abort(MPI_COMM_WORLD, 1);
+		}
+
+		if (!alignedBlocks && depthCommutator != MPI_COMM_NULL) {
+			MPI_Bcast(blockA.data, blockA.width * blockA.height, MPI_INT, 0, depthCommutator);
+			MPI_Bcast(blockB.data, blockB.width * blockB.height, MPI_INT, 0, depthCommutator);
 		}
 	}
 
+	// Время измеряется от готовности входных блоков во всех процессах до получения C, без ввода и вывода
+	MPI_Barrier(MPI_COMM_WORLD);
+
+	if (processRank == 0) {
+		startTime = MPI_Wtime();
+	}
+
+	if (algorithm == "2.5d") {
+		multiplyCannon(blockA, blockB, blockC, gridCommutator, multiplyThreads, strassenCutoff, firstStep, lastStep - firstStep,
+			alignedBlocks);
+		MPI_Reduce(layer == 0 ? MPI_IN_PLACE : blockC.data, blockC.data, blockC.width * blockC.height, MPI_INT, MPI_SUM, 0,
+			depthCommutator);
+	}
+	else if (algorithm == "cannon") {
+		multiplyCannon(blockA, blockB, blockC, gridCommutator, multiplyThreads, strassenCutoff, 0, 0, alignedBlocks);
+	}
+	else {
+		multiplySumma(blockA, blockB, blockC, panelWidth, gridCommutator, multiplyThreads);
+	}
+
+	MPI_Barrier(MPI_COMM_WORLD);
+
 	if (processRank == 0) {
 		double elapsedTime = MPI_Wtime() - startTime;
 		std::cout << "Elapsed time: " << elapsedTime << " sec.\n";
 	}
 
-	if (outputMatrix && processRank == 0) {
-		for (size_t y = 0; y < matrixSize; ++y) {
-			for (size_t x = 0; x < matrixSize; ++x) {
+	Matrix* matrixC = nullptr;
+
+	// Без вывода процесс 0 хранит только свои блоки
+	if (outputMatrix && processRank == 0 && pathC.empty()) {
+		matrixC = new Matrix(matrixColumns, matrixRows, gridColumns, gridRows, blockC.width, blockC.height);
+	}
+
+	if (layer == 0 && !pathC.empty()) {
+		if (!writeMatrixBlock(pathC, blockC, matrixColumns, matrixRows, gridCommutator) && processRank == 0) {
+			std::cerr << "The output file is not writable.\n";
+		}
+	}
+	else if (outputMatrix && layer == 0) {
+		gatherMatrix(blockC, matrixC, gridCommutator);
+	}
+
+	if (algorithm == "2.5d" && processRank == 0) {
+		// Оценка объема данных, принимаемых одним процессом (в элементах): сдвиги своей части шагов, начальный сдвиг
+		// и копирование блоков A и B по глубине (если блоки не сдвинуты при вводе), сложение блоков C по глубине.
+		// Для сравнения - двумерный алгоритм на том же числе процессов, в котором каждый процесс получает
+		// полосу строк A и полосу столбцов B
+		int dimensions2D[2] = { 0, 0 };
+
+		MPI_Dims_create(processNumber, 2, dimensions2D);
+
+		const double blocksAB = static_cast<double>(blockA.width) * blockA.height + static_cast<double>(blockB.width) * blockB.height;
+		const size_t shiftCount = divideRoundUp(gridColumns, replicas) - 1 + (alignedBlocks ? 0 : (pathA.empty() ? 1 : 2));
+		const double volume25D = shiftCount * blocksAB + static_cast<double>(blockC.width) * blockC.height;
+		const double volume2D = static_cast<double>(matrixRows) * matrixInner / dimensions2D[1]
+			+ static_cast<double>(matrixInner) * matrixColumns / dimensions2D[0];
+
+		std::cout << "Communication volume per process (estimate): 2.5D " << volume25D << " elements, 2D " << volume2D
+			<< " elements (2.5D / 2D = " << volume25D / volume2D << ")\n";
+	}
+
+	if (outputMatrix && processRank == 0 && matrixC != nullptr) {
+		for (size_t y = 0; y < matrixRows; ++y) {
+			for (size_t x = 0; x < matrixColumns; ++x) {
 				std::cout << matrixC->getValue(x, y) << " ";
 			}
 			std::cout << "\n";
 		}
 	}
 
-	delete blockA;
-	delete blockB;
-	delete blockC;
 	delete matrixC;
 
+	if (depthCommutator != MPI_COMM_NULL) {
+		MPI_Comm_free(&depthCommutator);
+	}
+	MPI_Comm_free(&gridCommutator);
 	MPI_Finalize();
 	return 0;
 }
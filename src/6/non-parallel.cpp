@@ -1,6 +1,17 @@
 #include <iostream>
 #include <fstream>
 #include <chrono>
+#include <string>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <future>
+#include <algorithm>
+
+#include "matrix-kernels.h"
+#include "matrix-file.h"
+#include "matrix-random.h"
 
 namespace non_parallel_functions
 {
@@ -29,67 +40,199 @@ namespace non_parallel_functions
 
 	ElementType& getValue(size_t rowIndex, size_t columnIndex)
 	{
+#ifndef NDEBUG
 	  if (rowIndex >= size || columnIndex >= size)
 	  {
 		throw std::exception("Invalid indexes.");
 	  }
-	  return *(data + rowIndex * size + columnIndex);
+#endif
+	  return data[rowIndex * size + columnIndex];
+	}
+
+	matrix_file::MatrixFileHeader getFileHeader() const
+	{
+	  return matrix_file::MatrixFileHeader(matrix_file::ElementKindOf<ElementType>::value, size, size, 1, 1, size, size);
 	}
   };
 
 
-  void readMatrixFromFile(Matrix& matrix, const std::string& path)
+  // Загрузить матрицу из двоичного файла (см. matrix-file.h). Матрица по строкам соответствует файлу из одного блока,
+  // такой файл копируется целиком, файл с другой разбивкой - частями строк
+  bool readMatrixFromFile(Matrix& matrix, const std::string& path)
   {
-	std::ifstream file(path);
+	matrix_file::MappedMatrixFile file;
 
-	if (file.is_open())
+	if (!file.open(path) || file.getData<ElementType>() == nullptr || file.header.width != matrix.size
+	  || file.header.height != matrix.size)
+	{
+	  return false;
+	}
+
+	if (file.header.hasSameLayout(matrix.getFileHeader()))
+	{
+	  std::memcpy(matrix.data, file.getData<ElementType>(), matrix.size * matrix.size * sizeof(ElementType));
+	}
+	else
 	{
 	  for (size_t y = 0; y < matrix.size; ++y)
 	  {
-		for (size_t x = 0; x < matrix.size; ++x)
-		{
-		  ElementType value;
-
-		  file >> value;
-
-		  matrix.getValue(x, y) = value;
-		}
+		file.readRowSegment(y, 0, matrix.size, matrix.data + y * matrix.size);
 	  }
 	}
 
-	file.close();
+	return true;
   }
 
-  void saveMatrixToFile(Matrix& matrix, const std::string& path)
+  bool saveMatrixToFile(Matrix& matrix, const std::string& path)
   {
-	std::ofstream file(path);
+	return matrix_file::writeMatrixFile(path, matrix.getFileHeader(), matrix.data);
+  }
+
+  // Сгенерировать случайную матрицу счетчиковым генератором (см. matrix-random.h): при том же зерне матрица
+  // совпадает с матрицами параллельных программ
+  void generateMatrix(Matrix& matrix, uint64_t seed)
+  {
+	matrix_random::generateMatrixPart(seed, matrix.size, matrix.size, 0, 0, matrix.size, matrix.size, matrix.data, matrix.size);
+  }
+
+  // Сравнение результата алгоритма Штрассена-Винограда с классическим умножением: разность не должна превышать
+  // сумму оценок погрешности обоих алгоритмов (классический соответствует порогу, равному размеру матриц)
+  void checkStrassenError(Matrix& matrixA, Matrix& matrixB, Matrix& matrixC, size_t strassenCutoff)
+  {
+	Matrix reference(matrixA.size);
+	double maxA = 0;
+	double maxB = 0;
+	double maxError = 0;
 
-	if (file.is_open())
+	matrix_kernels::multiplyAdd(matrixA.data, matrixB.data, reference.data, matrixA.size);
+
+	for (size_t i = 0; i < matrixA.size * matrixA.size; ++i)
 	{
-	  for (size_t y = 0; y < matrix.size; ++y)
-	  {
-		for (size_t x = 0; x < matrix.size; ++x)
-		{
-		  file << matrix.getValue(x, y) << " ";
-		}
-		file << "\n";
-	  }
+	  maxA = std::max(maxA, std::abs(static_cast<double>(matrixA.data[i])));
+	  maxB = std::max(maxB, std::abs(static_cast<double>(matrixB.data[i])));
+	  maxError = std::max(maxError, std::abs(static_cast<double>(matrixC.data[i]) - reference.data[i]));
 	}
 
-	file.close();
+	const double errorBound = matrix_kernels::strassenErrorBound<ElementType>(matrixA.size, strassenCutoff, maxA, maxB)
+	  + matrix_kernels::strassenErrorBound<ElementType>(matrixA.size, matrixA.size, maxA, maxB);
+
+	std::cout << "Strassen-Winograd max error: " << maxError << ", bound: " << errorBound
+	  << (maxError <= errorBound ? " (OK)" : " (EXCEEDED)") << "\n";
   }
 
-  void generateMatrix(Matrix& matrix)
+  // Скопировать плитку rows x columns, начинающуюся со строки firstRow и столбца firstColumn, из отображенного файла
+  // в буфер tile (по строкам подряд). Страницы файла подгружаются с диска во время копирования
+  void readTile(const matrix_file::MappedMatrixFile& file, size_t firstRow, size_t firstColumn, size_t rows, size_t columns,
+	ElementType* tile)
   {
-	srand(time(nullptr));
+	for (size_t y = 0; y < rows; ++y)
+	{
+	  file.readRowSegment(firstRow + y, firstColumn, columns, tile + y * columns);
+	}
+  }
 
-	for (size_t y = 0; y < matrix.size; ++y)
+  // Записать плитку rows x columns на ее место в файле матрицы шириной matrixWidth, хранящейся по строкам
+  void writeTile(std::ofstream& file, size_t matrixWidth, size_t firstRow, size_t firstColumn, size_t rows, size_t columns,
+	const ElementType* tile)
+  {
+	for (size_t y = 0; y < rows; ++y)
 	{
-	  for (size_t x = 0; x < matrix.size; ++x)
+	  file.seekp(sizeof(matrix_file::MatrixFileHeader) + ((firstRow + y) * matrixWidth + firstColumn) * sizeof(ElementType));
+	  file.write(reinterpret_cast<const char*>(tile + y * columns), columns * sizeof(ElementType));
+	}
+  }
+
+  // Умножение матриц из двоичных файлов (см. matrix-file.h), которые не помещаются в память: C = A * B вычисляется
+  // плитками tileSize x tileSize. В памяти находятся только плитка C и две пары плиток A и B: пока умножается текущая пара,
+  // следующая копируется из отображенных файлов в фоновом потоке. Готовая плитка C сразу записывается в файл результата
+  bool multiplyOutOfCore(const std::string& pathA, const std::string& pathB, const std::string& pathC, size_t tileSize)
+  {
+	matrix_file::MappedMatrixFile fileA;
+	matrix_file::MappedMatrixFile fileB;
+
+	if (!fileA.open(pathA) || !fileB.open(pathB) || fileA.getData<ElementType>() == nullptr
+	  || fileB.getData<ElementType>() == nullptr || fileA.header.width != fileB.header.height)
+	{
+	  return false;
+	}
+
+	const size_t rows = fileA.header.height;
+	const size_t inner = fileA.header.width;
+	const size_t columns = fileB.header.width;
+	const size_t tileRows = (rows + tileSize - 1) / tileSize;
+	const size_t tileInner = (inner + tileSize - 1) / tileSize;
+	const size_t tileColumns = (columns + tileSize - 1) / tileSize;
+	const size_t stepCount = tileRows * tileColumns * tileInner;
+	const matrix_file::MatrixFileHeader headerC(matrix_file::ElementKindOf<ElementType>::value, columns, rows, 1, 1, columns, rows);
+	std::ofstream fileC(pathC, std::ios::binary);
+
+	if (!fileC.is_open())
+	{
+	  return false;
+	}
+
+	fileC.write(reinterpret_cast<const char*>(&headerC), sizeof(headerC));
+
+	std::vector<ElementType> tilesA[2];
+	std::vector<ElementType> tilesB[2];
+	std::vector<ElementType> tileC(tileSize * tileSize, 0);
+
+	for (int buffer = 0; buffer < 2; ++buffer)
+	{
+	  tilesA[buffer].resize(tileSize * tileSize);
+	  tilesB[buffer].resize(tileSize * tileSize);
+	}
+
+	std::cout << "Out-of-core multiply: " << rows << "x" << inner << "x" << columns << ", tile " << tileSize
+	  << ", working set " << 5 * tileSize * tileSize * sizeof(ElementType) / (1 << 20) << " MiB\n";
+
+	// Шаг step умножает плитки A(i, p) и B(p, j) и прибавляет результат к плитке C(i, j): плитки C перебираются
+	// по строкам, для каждой из них подряд идут все tileInner слагаемых
+	auto loadStep = [&](size_t step, int buffer)
+	{
+	  const size_t i = step / (tileColumns * tileInner);
+	  const size_t j = step / tileInner % tileColumns;
+	  const size_t p = step % tileInner;
+	  const size_t depth = std::min(tileSize, inner - p * tileSize);
+
+	  readTile(fileA, i * tileSize, p * tileSize, std::min(tileSize, rows - i * tileSize), depth, tilesA[buffer].data());
+	  readTile(fileB, p * tileSize, j * tileSize, depth, std::min(tileSize, columns - j * tileSize), tilesB[buffer].data());
+	};
+
+	std::future<void> prefetch;
+
+	if (stepCount != 0)
+	{
+	  prefetch = std::async(std::launch::async, loadStep, 0, 0);
+	}
+
+	for (size_t step = 0; step < stepCount; ++step)
+	{
+	  const int buffer = step % 2;
+	  const size_t i = step / (tileColumns * tileInner);
+	  const size_t j = step / tileInner % tileColumns;
+	  const size_t p = step % tileInner;
+	  const size_t m = std::min(tileSize, rows - i * tileSize);
+	  const size_t n = std::min(tileSize, columns - j * tileSize);
+	  const size_t k = std::min(tileSize, inner - p * tileSize);
+
+	  prefetch.get();
+
+	  if (step + 1 < stepCount)
 	  {
-		matrix.getValue(x, y) = rand() % 100;
+		prefetch = std::async(std::launch::async, loadStep, step + 1, 1 - buffer);
+	  }
+
+	  matrix_kernels::multiplyAdd(tilesA[buffer].data(), tilesB[buffer].data(), tileC.data(), m, n, k, k, n, n);
+
+	  if (p + 1 == tileInner)
+	  {
+		writeTile(fileC, columns, i * tileSize, j * tileSize, m, n, tileC.data());
+		std::fill(tileC.begin(), tileC.end(), static_cast<ElementType>(0));
 	  }
 	}
+
+	return fileC.good();
   }
 }
 
@@ -98,42 +241,81 @@ using namespace non_parallel_functions;
 int main(int argc, char** argv)
 {
   const bool matrixOutput = false;
-  const size_t matrixSize = 128;
+
+  // Режим умножения вне оперативной памяти: ooc A.bin B.bin C.bin [размер плитки, по умолчанию 2048]
+  if (argc > 1 && std::string(argv[1]) == "ooc")
+  {
+	const size_t tileSize = argc > 5 ? std::strtoull(argv[5], nullptr, 10) : 2048;
+
+	if (argc < 5 || argc > 6 || tileSize == 0)
+	{
+	  std::cerr << "Usage: " << argv[0] << " ooc A.bin B.bin C.bin [tile size]\n";
+	  return 0;
+	}
+
+	auto startTime = std::chrono::steady_clock::now();
+
+	if (!multiplyOutOfCore(argv[2], argv[3], argv[4], tileSize))
+	{
+	  std::cerr << "The input files are not readable, the matrices cannot be multiplied or the output file is not writable.\n";
+	  return 1;
+	}
+
+	auto elapsedTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime);
+	std::cout << "Elapsed time: " << (double)elapsedTime.count() / 1000000 << "\n";
+	return 0;
+  }
+
+  // Аргументы командной строки: размер матриц (по умолчанию 128), порог алгоритма Штрассена-Винограда
+  // (0 - классическое блочное умножение) и "check" для сравнения результата с классическим умножением
+  const size_t matrixSize = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 128;
+  const size_t strassenCutoff = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 0;
+  const bool checkStrassen = argc > 3 && std::string(argv[3]) == "check";
+  // Зерно генератора матриц: A генерируется с зерном matrixSeed, B - с зерном matrixSeed + 1
+  const uint64_t matrixSeed = 2024;
+
+  if (matrixSize == 0)
+  {
+	std::cerr << "Usage: " << argv[0] << " [size] [strassen cutoff] [check]\n"
+	  << "       " << argv[0] << " ooc A.bin B.bin C.bin [tile size]\n";
+	return 0;
+  }
 
   Matrix matrixA(matrixSize);
   Matrix matrixB(matrixSize);
   Matrix matrixC(matrixSize);
 
-  generateMatrix(matrixA);
-  generateMatrix(matrixB);
+  generateMatrix(matrixA, matrixSeed);
+  generateMatrix(matrixB, matrixSeed + 1);
 
   auto startTime = std::chrono::steady_clock::now();
 
-  for (size_t y = 0; y < matrixSize; ++y)
+  // Матрицы хранятся по строкам (элемент getValue(y, x) - строка y, столбец x), как и в двоичных файлах: C = A * B
+  if (strassenCutoff != 0)
   {
-	for (size_t x = 0; x < matrixSize; ++x)
-	{
-	  ElementType value = 0;
-
-	  for (size_t i = 0; i < matrixSize; ++i)
-	  {
-		value += matrixA.getValue(i, y) * matrixB.getValue(x, i);
-	  }
-
-	  matrixC.getValue(x, y) = value;
-	}
+	matrix_kernels::multiplyAddStrassen(matrixA.data, matrixB.data, matrixC.data, matrixSize, matrixSize, matrixSize,
+	  matrixSize, matrixSize, matrixSize, strassenCutoff, 1);
+  }
+  else
+  {
+	matrix_kernels::multiplyAdd(matrixA.data, matrixB.data, matrixC.data, matrixSize);
   }
 
   auto elapsedTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime);
   std::cout << "Elapsed time: " << (double)elapsedTime.count() / 1000000 << "\n";
 
+  if (strassenCutoff != 0 && checkStrassen)
+  {
+	checkStrassenError(matrixA, matrixB, matrixC, strassenCutoff);
+  }
+
   if (matrixOutput)
   {
 	for (size_t y = 0; y < matrixSize; ++y)
 	{
 	  for (size_t x = 0; x < matrixSize; ++x)
 	  {
-		std::cout << matrixC.getValue(x, y) << " ";
+		std::cout << matrixC.getValue(y, x) << " ";
 	  }
 	  std::cout << std::endl;
 	}
@@ -1,13 +1,21 @@
 #include <iostream>
 #include <functional>
 #include <array>
-#include <list>
+#include <atomic>
 #include <vector>
 #include <set>
+#include <unordered_map>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <fstream>
+#include <cstring>
 #include <omp.h>
 
+#include "matrix-kernels.h"
+#include "matrix-file.h"
+#include "matrix-random.h"
+
 namespace
 {
   /*!
@@ -18,6 +26,22 @@ namespace
 	SUM = 0
   };
 
+  /*!
+   * \brief Политика ожидания сообщений.
+   *
+   * SPIN - поток непрерывно опрашивает хранилище сообщений.
+   * ADAPTIVE - поток опрашивает хранилище WAIT_SPIN_COUNT раз, после чего засыпает до прихода нового сообщения.
+   */
+  enum WaitPolicy
+  {
+	SPIN = 0,
+	ADAPTIVE = 1
+  };
+
+  constexpr int THREADS = 64;
+  constexpr WaitPolicy WAIT_POLICY = WaitPolicy::ADAPTIVE;
+  constexpr int WAIT_SPIN_COUNT = 4000;
+
   /*!
    * \brief Сообщение. Содержит данные и информацию об отправителе.
    */
@@ -30,8 +54,14 @@ namespace
 	  data{ nullptr },
 	  count{ 0 },
 	  typeSize{ 0 },
+	  bufferClass{ 0 },
 	  senderId{ ANY_THREAD },
-	  tag{ ANY_TAG }
+	  ownerId{ ANY_THREAD },
+	  tag{ ANY_TAG },
+	  ownsData{ false },
+	  delivered{ false },
+	  sequence{ 0 },
+	  next{ nullptr }
 	{}
 
 	Message(const Message&) = delete;
@@ -39,94 +69,441 @@ namespace
 	Message(Message&&) = delete;
 	Message& operator=(Message&&) = delete;
 
-	~Message()
+	/*!
+	 * \brief Скопировать данные в буфер сообщения. Буфер выделяется пулом сообщений (MessagePool::acquireMessage).
+	 */
+	void setData(void* data, int count, int typeSize, int senderId = ANY_THREAD, int tag = ANY_TAG)
 	{
-	  reset();
+	  this->senderId = senderId;
+	  this->count = count;
+	  this->typeSize = typeSize;
+	  this->tag = tag;
+	  this->ownsData = true;
+	  std::memcpy(this->data, data, count * typeSize);
 	}
 
-	void setData(void* data, int count, int typeSize, int senderId = ANY_THREAD, int tag = ANY_TAG)
+	/*!
+	 * \brief Передать в сообщении указатель на буфер отправителя без копирования данных (режим рандеву).
+	 *
+	 * Буфер должен оставаться неизменным до тех пор, пока получатель не выставит флаг delivered.
+	 */
+	void setReference(void* data, int count, int typeSize, int senderId = ANY_THREAD, int tag = ANY_TAG)
 	{
 	  reset();
 	  this->senderId = senderId;
 	  this->count = count;
 	  this->typeSize = typeSize;
-	  this->data = new char[count * typeSize];
+	  this->data = data;
 	  this->tag = tag;
-	  std::memcpy(this->data, data, count * typeSize);
 	}
 
 	void reset()
 	{
-	  if (data != nullptr)
-	  {
-		delete[] data;
-		data = nullptr;
-	  }
+	  data = nullptr;
 	  count = 0;
 	  typeSize = 0;
 	  senderId = ANY_THREAD;
 	  tag = ANY_TAG;
+	  ownsData = false;
+	  delivered.store(false, std::memory_order_relaxed);
 	}
 
 	void* data;		    // Указатель на данные
 	size_t count;		// Количество данных
 	size_t typeSize;	// Размер типа данных
+	int bufferClass;	// Класс размера буфера данных в пуле сообщений
 	short int senderId; // ID потока-отправителя
+	short int ownerId;	// ID потока, пулу которого принадлежит сообщение
 	short int tag;		// Тег сообщения
+	bool ownsData;		// Данные скопированы в буфер из пула (иначе указывают на буфер отправителя)
+	std::atomic<bool> delivered; // Получатель скопировал данные из буфера отправителя (режим рандеву)
+	size_t sequence;	// Порядковый номер сообщения в хранилище получателя
+	Message* next;		// Следующее сообщение в очереди
+  };
+
+  /*!
+   * \brief Очередь сообщений (FIFO) на основе интрусивного списка.
+   */
+  struct MessageQueue
+  {
+	Message* first = nullptr;	// Начало очереди
+	Message* last = nullptr;	// Конец очереди
+
+	void push(Message* message)
+	{
+	  message->next = nullptr;
+
+	  if (last == nullptr)
+	  {
+		first = message;
+	  }
+	  else
+	  {
+		last->next = message;
+	  }
+	  last = message;
+	}
+
+	Message* pop()
+	{
+	  Message* message = first;
+	  first = message->next;
+
+	  if (first == nullptr)
+	  {
+		last = nullptr;
+	  }
+
+	  message->next = nullptr;
+	  return message;
+	}
   };
 
   /*!
-   * \brief Хранилище сообщений. Хранит сообщения для определенного потока в виде связного списка.
+   * \brief Пул сообщений потока. Переиспользует заголовки сообщений и буферы данных.
+   *
+   * Буферы разбиты на классы по размеру (степени двойки от 2^MIN_SIZE_CLASS до 2^(SIZE_CLASSES - 1) байт),
+   * буферы большего размера выделяются и освобождаются напрямую. Получатель возвращает сообщение в пул потока-владельца
+   * через lock-free стек возвращенных сообщений, который владелец забирает целиком при следующем выделении.
+   */
+  struct MessagePool
+  {
+	static const int MIN_SIZE_CLASS = 4;
+	static const int SIZE_CLASSES = 25;
+
+	explicit MessagePool() :
+	  freeMessages{ nullptr },
+	  freeBuffers{},
+	  returned{ nullptr },
+	  messageHits{ 0 },
+	  messageMisses{ 0 },
+	  bufferHits{ 0 },
+	  bufferMisses{ 0 }
+	{}
+
+	MessagePool(const MessagePool&) = delete;
+	MessagePool& operator=(const MessagePool&) = delete;
+
+	/*!
+	 * \brief Освободить заголовки и буферы, накопленные пулом, в том числе возвращенные получателями.
+	 */
+	~MessagePool()
+	{
+	  collectReturned();
+
+	  while (freeMessages != nullptr)
+	  {
+		Message* next = freeMessages->next;
+		delete freeMessages;
+		freeMessages = next;
+	  }
+
+	  for (char*& buffer : freeBuffers)
+	  {
+		while (buffer != nullptr)
+		{
+		  char* next = *reinterpret_cast<char**>(buffer);
+		  delete[] buffer;
+		  buffer = next;
+		}
+	  }
+	}
+
+	/*!
+	 * \brief Выделить сообщение с буфером данных размером не менее size байт. Вызывается только потоком-владельцем.
+	 */
+	Message* acquireMessage(int ownerId, size_t size)
+	{
+	  if (returned.load(std::memory_order_relaxed) != nullptr)
+	  {
+		collectReturned();
+	  }
+
+	  Message* message = freeMessages;
+
+	  if (message != nullptr)
+	  {
+		freeMessages = message->next;
+		message->next = nullptr;
+		++messageHits;
+	  }
+	  else
+	  {
+		message = new Message;
+		++messageMisses;
+	  }
+
+	  message->ownerId = ownerId;
+	  message->bufferClass = getSizeClass(size);
+	  message->data = acquireBuffer(message->bufferClass, size);
+
+	  return message;
+	}
+
+	/*!
+	 * \brief Вернуть сообщение в пул. Может вызываться любым потоком.
+	 */
+	void releaseMessage(Message* message)
+	{
+	  message->next = returned.load(std::memory_order_relaxed);
+
+	  while (!returned.compare_exchange_weak(message->next, message, std::memory_order_release, std::memory_order_relaxed))
+	  {
+	  }
+	}
+
+	void* acquireBuffer(int sizeClass, size_t size)
+	{
+	  if (sizeClass >= SIZE_CLASSES)
+	  {
+		++bufferMisses;
+		return new char[size];
+	  }
+
+	  char* buffer = freeBuffers[sizeClass];
+
+	  if (buffer != nullptr)
+	  {
+		freeBuffers[sizeClass] = *reinterpret_cast<char**>(buffer);
+		++bufferHits;
+		return buffer;
+	  }
+
+	  ++bufferMisses;
+	  return new char[static_cast<size_t>(1) << sizeClass];
+	}
+
+	/*!
+	 * \brief Перенести возвращенные сообщения и их буферы в списки свободных.
+	 */
+	void collectReturned()
+	{
+	  Message* message = returned.exchange(nullptr, std::memory_order_acquire);
+
+	  while (message != nullptr)
+	  {
+		Message* next = message->next;
+		char* buffer = static_cast<char*>(message->data);
+
+		if (message->bufferClass < SIZE_CLASSES)
+		{
+		  *reinterpret_cast<char**>(buffer) = freeBuffers[message->bufferClass];
+		  freeBuffers[message->bufferClass] = buffer;
+		}
+		else
+		{
+		  delete[] buffer;
+		}
+
+		message->data = nullptr;
+		message->next = freeMessages;
+		freeMessages = message;
+		message = next;
+	  }
+	}
+
+	static int getSizeClass(size_t size)
+	{
+	  int sizeClass = MIN_SIZE_CLASS;
+
+	  while ((static_cast<size_t>(1) << sizeClass) < size)
+	  {
+		++sizeClass;
+	  }
+
+	  return sizeClass;
+	}
+
+	Message* freeMessages;				// Список свободных заголовков (доступен только потоку-владельцу)
+	char* freeBuffers[SIZE_CLASSES];		// Списки свободных буферов по классам размера
+	std::atomic<Message*> returned;		// Стек сообщений, возвращенных получателями
+	size_t messageHits;					// Заголовки, взятые из пула
+	size_t messageMisses;					// Заголовки, выделенные в куче
+	size_t bufferHits;					// Буферы, взятые из пула
+	size_t bufferMisses;					// Буферы, выделенные в куче
+  };
+
+  /*!
+   * \brief Хранилище сообщений. Хранит сообщения для определенного потока.
+   *
+   * Отправители добавляют сообщения в стек входящих сообщений без блокировок (CAS на вершине стека).
+   * Поток-владелец забирает стек целиком и раскладывает сообщения по очередям, доступ к которым имеет только он,
+   * поэтому ни отправка, ни поиск сообщения не требуют взятия мьютекса.
+   *
+   * Для каждой пары (отправитель, тег) хранится отдельная очередь, поэтому прием от конкретного потока с конкретным
+   * тегом выполняется за O(1). При приеме с ANY_THREAD/ANY_TAG выбирается сообщение с наименьшим порядковым номером
+   * среди голов подходящих очередей, что сохраняет порядок поступления сообщений.
    */
   struct ThreadInputStorage
   {
 	explicit ThreadInputStorage() :
-	  messages{},
-	  storageLock{ nullptr }
+	  incoming{ nullptr },
+	  queues{},
+	  nextSequence{ 0 },
+	  sleeping{ false },
+	  sleepMutex{},
+	  wakeup{}
+	{}
+
+	void pushMessage(Message* message)
 	{
-	  omp_init_lock(&storageLock);
+	  message->next = incoming.load(std::memory_order_relaxed);
+
+	  while (!incoming.compare_exchange_weak(message->next, message, std::memory_order_release, std::memory_order_relaxed))
+	  {
+	  }
+
+	  notify();
 	}
 
-	~ThreadInputStorage()
+	/*!
+	 * \brief Разбудить поток-владельца, если он спит в ожидании.
+	 */
+	void notify()
 	{
-	  omp_destroy_lock(&storageLock);
+	  if (WAIT_POLICY != WaitPolicy::ADAPTIVE)
+	  {
+		return;
+	  }
+
+	  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	  if (sleeping.load(std::memory_order_relaxed))
+	  {
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		wakeup.notify_one();
+	  }
 	}
 
-	void pushMessage(Message* message)
+	/*!
+	 * \brief Усыпить поток-владельца до выполнения условия. Условие перепроверяется после каждого вызова notify().
+	 */
+	template<typename Condition>
+	void sleepUntil(Condition ready)
 	{
-	  omp_set_lock(&storageLock);
-	  messages.push_back(message);
-	  omp_unset_lock(&storageLock);
+	  std::unique_lock<std::mutex> lock(sleepMutex);
+	  sleeping.store(true, std::memory_order_relaxed);
+	  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	  while (!ready())
+	  {
+		wakeup.wait(lock);
+	  }
+
+	  sleeping.store(false, std::memory_order_relaxed);
+	}
+
+	/*!
+	 * \brief Дождаться выполнения условия согласно политике WAIT_POLICY.
+	 */
+	template<typename Condition>
+	void waitUntil(Condition ready)
+	{
+	  for (int spins = 0; !ready(); ++spins)
+	  {
+		if (WAIT_POLICY == WaitPolicy::ADAPTIVE && spins >= WAIT_SPIN_COUNT)
+		{
+		  sleepUntil(ready);
+		  return;
+		}
+	  }
 	}
 
 	Message* popMessage(int senderId = Message::ANY_THREAD, int messageTag = Message::ANY_TAG)
 	{
-	  Message* result = nullptr;
+	  Message* result = findMessage(senderId, messageTag);
 
-	  omp_set_lock(&storageLock);
-	  if (!messages.empty())
+	  if (result == nullptr && incoming.load(std::memory_order_relaxed) != nullptr)
+	  {
+		collectIncoming();
+		result = findMessage(senderId, messageTag);
+	  }
+
+	  return result;
+	}
+
+	/*!
+	 * \brief Разложить входящие сообщения по очередям потока-владельца, сохраняя порядок их отправки.
+	 */
+	void collectIncoming()
+	{
+	  Message* message = incoming.exchange(nullptr, std::memory_order_acquire);
+	  Message* head = nullptr;
+
+	  while (message != nullptr)
 	  {
-		for (auto it = messages.cbegin(); it != messages.cend(); ++it)
+		Message* next = message->next;
+		message->next = head;
+		head = message;
+		message = next;
+	  }
+
+	  while (head != nullptr)
+	  {
+		Message* next = head->next;
+		head->sequence = nextSequence++;
+		queues[head->senderId][head->tag].push(head);
+		head = next;
+	  }
+	}
+
+	/*!
+	 * \brief Найти и извлечь из очередей потока-владельца самое раннее подходящее сообщение.
+	 */
+	Message* findMessage(int senderId, int messageTag)
+	{
+	  if (senderId != Message::ANY_THREAD && (senderId < 0 || senderId >= THREADS))
+	  {
+		return nullptr;
+	  }
+
+	  const int firstSource = (senderId == Message::ANY_THREAD) ? 0 : senderId;
+	  const int lastSource = (senderId == Message::ANY_THREAD) ? THREADS - 1 : senderId;
+	  MessageQueue* result = nullptr;
+
+	  const auto selectQueue = [&result](MessageQueue& queue)
+	  {
+		if (queue.first != nullptr && (result == nullptr || queue.first->sequence < result->first->sequence))
 		{
-		  if ((senderId == Message::ANY_THREAD || senderId == (*it)->senderId) && (messageTag == Message::ANY_TAG || (*it)->tag == messageTag))
+		  result = &queue;
+		}
+	  };
+
+	  for (int source = firstSource; source <= lastSource; ++source)
+	  {
+		auto& sourceQueues = queues[source];
+
+		if (messageTag == Message::ANY_TAG)
+		{
+		  for (auto& tagQueue : sourceQueues)
+		  {
+			selectQueue(tagQueue.second);
+		  }
+		}
+		else
+		{
+		  const auto it = sourceQueues.find(messageTag);
+		  if (it != sourceQueues.end())
 		  {
-			result = *it;
-			messages.erase(it);
-			break;
+			selectQueue(it->second);
 		  }
 		}
 	  }
-	  omp_unset_lock(&storageLock);
 
-	  return result;
+	  return (result != nullptr) ? result->pop() : nullptr;
 	}
 
-	std::list<Message*> messages;	// Связный список сообщений
-	omp_lock_t storageLock;		    // Мьютекс на доступ к списку сообщений
+	std::atomic<Message*> incoming;	// Стек входящих сообщений (заполняется отправителями)
+	std::array<std::unordered_map<int, MessageQueue>, THREADS> queues; // Очереди сообщений по отправителю и тегу (доступны только потоку-владельцу)
+	size_t nextSequence;		// Порядковый номер следующего сообщения
+	std::atomic<bool> sleeping;	// Поток-владелец спит в ожидании notify()
+	std::mutex sleepMutex;		// Мьютекс условной переменной
+	std::condition_variable wakeup; // Условная переменная пробуждения потока-владельца
   };
 
-  constexpr int THREADS = 64;
+  constexpr size_t RENDEZVOUS_THRESHOLD = 64 * 1024; // Размер сообщения в байтах, начиная с которого данные не копируются в сообщение
   std::array<ThreadInputStorage, THREADS> INPUT_STORAGES;
+  std::array<MessagePool, THREADS> MESSAGE_POOLS;
 
   /*!
    * \brief Топология процессов в виде сетки.
@@ -243,10 +620,78 @@ namespace
 	}
   };
 
+  /*!
+   * \brief Вывести долю заголовков и буферов сообщений, взятых из пулов потоков.
+   */
+  void printMessagePoolStatistics()
+  {
+	size_t messageHits = 0, messageMisses = 0, bufferHits = 0, bufferMisses = 0;
+
+	for (const auto& pool : MESSAGE_POOLS)
+	{
+	  messageHits += pool.messageHits;
+	  messageMisses += pool.messageMisses;
+	  bufferHits += pool.bufferHits;
+	  bufferMisses += pool.bufferMisses;
+	}
+
+	std::cout << "Message pool hit rate: headers " << messageHits << "/" << messageHits + messageMisses
+	  << ", buffers " << bufferHits << "/" << bufferHits + bufferMisses << "\n";
+  }
+
+  /*!
+   * \brief Дождаться, пока получатель скопирует данные сообщения, переданного в режиме рандеву.
+   */
+  void waitDelivery(const Message& message)
+  {
+	INPUT_STORAGES.at(omp_get_thread_num()).waitUntil([&message]()
+	{
+	  return message.delivered.load(std::memory_order_acquire);
+	});
+  }
+
+  /*!
+   * \brief Освободить полученное сообщение. Отправитель сообщения в режиме рандеву уведомляется о завершении копирования.
+   */
+  void releaseMessage(Message* message)
+  {
+	if (message->ownsData)
+	{
+	  MESSAGE_POOLS.at(message->ownerId).releaseMessage(message);
+	}
+	else
+	{
+	  // После выставления флага отправитель может уничтожить сообщение, поэтому хранилище отправителя определяется заранее
+	  auto& senderStorage = INPUT_STORAGES.at(message->senderId);
+	  message->delivered.store(true, std::memory_order_release);
+	  senderStorage.notify();
+	}
+  }
+
+  /*!
+   * \brief Скопировать данные полученного сообщения в буфер получателя и освободить сообщение.
+   */
+  void consumeMessage(Message* message, void* data, int count, int typeSize)
+  {
+	size_t size = count * typeSize;
+	if (size > message->count * message->typeSize)
+	{
+	  size = message->count * message->typeSize;
+	}
+
+	std::memcpy(data, message->data, size);
+
+	releaseMessage(message);
+  }
+
   /*!
    * \brief Функция отправки сообщения другому потоку.
    *
    * Функция является блокирующей - освобождается после того, как данные из входного буффера будут скопированы и отправлены.
+   * Сообщения размером от RENDEZVOUS_THRESHOLD байт другим потокам передаются без промежуточной копии: функция
+   * освобождается после того, как получатель скопирует данные напрямую из входного буффера. Поэтому два потока,
+   * отправляющие такие сообщения друг другу до вызова recieveData, блокируются навсегда - для обмена сообщениями
+   * используются sendRecieveData или isendData. Сообщения самому себе всегда копируются.
    *
    * \param data Указатель на массив данных, который необходимо отправить
    * \param count Количество элементов в массиве данных
@@ -262,8 +707,19 @@ namespace
 	}
 
 	auto& storage = INPUT_STORAGES.at(destination);
-	auto* message = new Message;
-	message->setData(data, count, typeSize, omp_get_thread_num(), tag);
+
+	if (static_cast<size_t>(count) * typeSize >= RENDEZVOUS_THRESHOLD && destination != omp_get_thread_num())
+	{
+	  Message message;
+	  message.setReference(data, count, typeSize, omp_get_thread_num(), tag);
+	  storage.pushMessage(&message);
+	  waitDelivery(message);
+	  return;
+	}
+
+	const auto threadId = omp_get_thread_num();
+	auto* message = MESSAGE_POOLS.at(threadId).acquireMessage(threadId, static_cast<size_t>(count) * typeSize);
+	message->setData(data, count, typeSize, threadId, tag);
 	storage.pushMessage(message);
   }
 
@@ -285,41 +741,262 @@ namespace
 
 	while (message == nullptr)
 	{
+	  storage.waitUntil([&storage]()
+	  {
+		return storage.incoming.load(std::memory_order_relaxed) != nullptr;
+	  });
 	  message = storage.popMessage(source, tag);
 	}
 
-	size_t size = count * typeSize;
-	if (size > message->count * message->typeSize)
+	consumeMessage(message, data, count, typeSize);
+  }
+
+  /*!
+   * \brief Функция одновременной отправки сообщения одному потоку и приема сообщения от другого потока.
+   *
+   * Функция является блокирующей - освобождается после того, как сообщение будет получено, а отправленные данные
+   * будут скопированы получателем. Буферы отправки и приема не должны пересекаться. В отличие от пары вызовов
+   * sendData/recieveData не приводит к взаимной блокировке при циклическом сдвиге сообщений в режиме рандеву.
+   *
+   * \param sendBuffer Указатель на массив данных, который необходимо отправить
+   * \param recvBuffer Указатель на массив данных, куда необходимо записать полученные данные
+   * \param count Количество элементов в массивах данных
+   * \param typeSize Размер одного элемента массива в байтах
+   * \param destination ID потока, которому необходимо отправить сообщение
+   * \param source ID потока, от которого необходимо получить сообщение
+   * \param tag Тег сообщений
+   */
+  void sendRecieveData(void* sendBuffer, void* recvBuffer, int count, int typeSize, int destination, int source, int tag = Message::ANY_TAG)
+  {
+	if (destination < 0 || destination >= THREADS || destination == omp_get_thread_num()
+	  || static_cast<size_t>(count) * typeSize < RENDEZVOUS_THRESHOLD)
 	{
-	  size = message->count * message->typeSize;
+	  sendData(sendBuffer, count, typeSize, destination, tag);
+	  recieveData(recvBuffer, count, typeSize, source, tag);
+	  return;
 	}
 
-	std::memcpy(data, message->data, size);
+	Message message;
+	message.setReference(sendBuffer, count, typeSize, omp_get_thread_num(), tag);
+	INPUT_STORAGES.at(destination).pushMessage(&message);
+
+	recieveData(recvBuffer, count, typeSize, source, tag);
+	waitDelivery(message);
+  }
+
+  /*!
+   * \brief Запрос неблокирующей операции обмена сообщениями.
+   */
+  struct Request
+  {
+	enum Type
+	{
+	  NONE = 0,
+	  SEND = 1,
+	  RECIEVE = 2
+	};
+
+	Type type = Type::NONE;
+	bool completed = true;		// Операция завершена
+	Message* message = nullptr;	// Сообщение, отправленное в режиме рандеву (SEND)
+	void* data = nullptr;		// Буфер приема (RECIEVE)
+	int count = 0;				// Количество элементов в буфере приема
+	int typeSize = 0;			// Размер одного элемента в байтах
+	int source = Message::ANY_THREAD; // ID потока-отправителя
+	int tag = Message::ANY_TAG;	// Тег сообщения
+  };
+
+  /*!
+   * \brief Функция неблокирующей отправки сообщения другому потоку.
+   *
+   * Небольшие сообщения копируются сразу, и запрос завершается немедленно. Сообщения размером от RENDEZVOUS_THRESHOLD
+   * байт передаются в режиме рандеву: буфер data нельзя изменять, пока запрос не будет завершен.
+   *
+   * \param data Указатель на массив данных, который необходимо отправить
+   * \param count Количество элементов в массиве данных
+   * \param typeSize Размер одного элемента массива в байтах
+   * \param destination ID потока, которому необходимо отправить сообщение
+   * \param tag Тег сообщения
+   * \param request Запрос, по которому отслеживается завершение операции
+   */
+  void isendData(void* data, int count, int typeSize, int destination, int tag, Request& request)
+  {
+	request = Request{};
+	request.type = Request::Type::SEND;
+
+	if (destination < 0 || destination >= THREADS || static_cast<size_t>(count) * typeSize < RENDEZVOUS_THRESHOLD)
+	{
+	  sendData(data, count, typeSize, destination, tag);
+	  return;
+	}
+
+	request.completed = false;
+	request.message = new Message;
+	request.message->setReference(data, count, typeSize, omp_get_thread_num(), tag);
+	INPUT_STORAGES.at(destination).pushMessage(request.message);
+  }
+
+  /*!
+   * \brief Функция неблокирующего приема сообщения от другого потока.
+   *
+   * Сообщение сопоставляется с запросом при вызове test/testAll/waitAll, буфер data нельзя использовать,
+   * пока запрос не будет завершен.
+   *
+   * \param data Указатель на массив данных, куда необходимо записать полученные данные
+   * \param count Количество элементов в массиве данных
+   * \param typeSize Размер одного элемента массива в байтах
+   * \param source ID потока, от которого необходимо получить сообщение
+   * \param tag Тег сообщения
+   * \param request Запрос, по которому отслеживается завершение операции
+   */
+  void irecvData(void* data, int count, int typeSize, int source, int tag, Request& request)
+  {
+	request = Request{};
+	request.type = Request::Type::RECIEVE;
+	request.completed = false;
+	request.data = data;
+	request.count = count;
+	request.typeSize = typeSize;
+	request.source = source;
+	request.tag = tag;
+  }
+
+  /*!
+   * \brief Проверить завершение запроса, продвинув операцию, если это возможно. Функция не блокируется.
+   *
+   * \return true, если операция завершена
+   */
+  bool test(Request& request)
+  {
+	if (request.completed)
+	{
+	  return true;
+	}
+
+	if (request.type == Request::Type::SEND)
+	{
+	  if (!request.message->delivered.load(std::memory_order_acquire))
+	  {
+		return false;
+	  }
+
+	  delete request.message;
+	  request.message = nullptr;
+	}
+	else
+	{
+	  auto* message = INPUT_STORAGES.at(omp_get_thread_num()).popMessage(request.source, request.tag);
+	  if (message == nullptr)
+	  {
+		return false;
+	  }
 
-	delete message;
+	  consumeMessage(message, request.data, request.count, request.typeSize);
+	}
+
+	request.completed = true;
+	return true;
   }
 
   /*!
-  * \brief Функция сбора данных от всех потоков. Данные из sendBuffer всех потоков записываются в recvBuffer последовательно в порядке нумерации процессов.
-  *
-  * Функция является блокирующей - освобождается после того, как данные из сообщения буду получены.
-  *
-  * \param sendBuffer Указатель на массив данных, который необходимо отправить
-  * \param recvBuffer Указатель на массив данных, куда необходимо записать полученные данные
-  * \param count Количество элементов в массиве данных
-  * \param typeSize Размер одного элемента массива в байтах
-  * \param root ID потока, который должен собрать данные
-  */
-  void gatherData(void* sendBuffer, void* recvBuffer, int count, int typeSize, int root)
+   * \brief Проверить завершение всех запросов, продвинув операции, если это возможно. Функция не блокируется.
+   *
+   * \return true, если все операции завершены
+   */
+  bool testAll(Request* requests, int count)
   {
-	sendData(sendBuffer, count, typeSize, root);
+	bool completed = true;
+
+	for (int i = 0; i < count; ++i)
+	{
+	  completed = test(requests[i]) && completed;
+	}
+
+	return completed;
+  }
 
+  /*!
+   * \brief Дождаться завершения всех запросов.
+   *
+   * Запросы продвигаются одновременно, поэтому порядок запросов в массиве не может привести к взаимной блокировке.
+   */
+  void waitAll(Request* requests, int count)
+  {
+	auto& storage = INPUT_STORAGES.at(omp_get_thread_num());
+
+	while (!testAll(requests, count))
+	{
+	  // Входящее сообщение будит поток, только если есть незавершенный прием: иначе testAll не забирает входящие
+	  // сообщения, и сообщение, пришедшее заранее (например, блок следующего шага), вызывало бы активное ожидание
+	  storage.waitUntil([&storage, requests, count]()
+	  {
+		for (int i = 0; i < count; ++i)
+		{
+		  if (requests[i].completed)
+		  {
+			continue;
+		  }
+
+		  if (requests[i].type == Request::Type::RECIEVE ? storage.incoming.load(std::memory_order_relaxed) != nullptr
+			: requests[i].message->delivered.load(std::memory_order_acquire))
+		  {
+			return true;
+		  }
+		}
+
+		return false;
+	  });
+	}
+  }
+
+  /*!
+   * \brief Функция сбора данных от всех потоков с записью напрямую в буферы назначения.
+   *
+   * Корневой поток рассылает каждому потоку адрес, по которому должны быть записаны его данные, после чего потоки
+   * параллельно копируют свои данные в общую память и уведомляют корень о завершении. Корневой поток не копирует
+   * чужие данные и не использует промежуточный буфер.
+   *
+   * Функция является блокирующей - освобождается после того, как данные потока будут записаны (для отправителей)
+   * или как данные всех потоков будут записаны (для корня).
+   *
+   * \param sendBuffer Указатель на массив данных, который необходимо отправить
+   * \param count Количество элементов в массиве данных
+   * \param typeSize Размер одного элемента массива в байтах
+   * \param destinations Адреса назначения данных каждого потока, THREADS элементов (используется только в корне)
+   * \param root ID потока, который должен собрать данные
+   */
+  void gatherDataDirect(void* sendBuffer, int count, int typeSize, void* const* destinations, int root)
+  {
 	const auto threadId = omp_get_thread_num();
-	if (threadId == root)
+	const size_t size = static_cast<size_t>(count) * typeSize;
+	char completed = 1;
+
+	if (threadId != root)
 	{
-	  for (int i = 0; i < THREADS; ++i)
+	  void* destination = nullptr;
+
+	  recieveData(&destination, 1, sizeof(void*), root);
+	  std::memcpy(destination, sendBuffer, size);
+	  sendData(&completed, 1, sizeof(char), root);
+	  return;
+	}
+
+	for (int i = 0; i < THREADS; ++i)
+	{
+	  if (i != root)
 	  {
-		recieveData(static_cast<uint8_t*>(recvBuffer) + count * typeSize * i, count, typeSize, i);
+		void* destination = destinations[i];
+		sendData(&destination, 1, sizeof(void*), i);
+	  }
+	}
+
+	std::memcpy(destinations[root], sendBuffer, size);
+
+	for (int i = 0; i < THREADS; ++i)
+	{
+	  if (i != root)
+	  {
+		recieveData(&completed, 1, sizeof(char), i);
 	  }
 	}
   }
@@ -346,108 +1023,117 @@ namespace
 	  delete[] data;
 	}
 
+	/*!
+	 * \brief Элемент подматрицы. Индексы проверяются только в отладочной сборке.
+	 */
 	ElementType& getValue(size_t columnIndex, size_t rowIndex) {
+#ifndef NDEBUG
 	  if (rowIndex >= size || columnIndex >= size) {
 		throw std::exception("Invalid indexes.");
 	  }
-	  return *(data + rowIndex * size + columnIndex);
+#endif
+	  return data[rowIndex * size + columnIndex];
+	}
+
+	/*!
+	 * \brief Строка подматрицы (size элементов подряд).
+	 */
+	ElementType* getRow(size_t rowIndex) {
+	  return data + rowIndex * size;
 	}
   };
 
   /*!
-   * \brief Матрица.
+   * \brief Матрица. Все блоки хранятся подряд в одном буфере: блок (x, y) начинается
+   * с элемента (x * blockCount + y) * blockSize * blockSize, внутри блока элементы хранятся по строкам.
    */
   struct Matrix {
 	size_t blockCount = 0;
 	size_t blockSize = 0;
-	Submatrix** blocks = nullptr;
+	ElementType* data = nullptr;
 
 	Matrix(size_t blockCount, size_t blockSize) {
 	  this->blockCount = blockCount;
 	  this->blockSize = blockSize;
-	  this->blocks = new Submatrix * [blockCount * blockCount];
+	  this->data = new ElementType[blockCount * blockCount * blockSize * blockSize];
 
-	  for (size_t i = 0; i < blockCount * blockCount; ++i) {
-		this->blocks[i] = new Submatrix(blockSize);
+	  for (size_t i = 0; i < blockCount * blockCount * blockSize * blockSize; ++i) {
+		this->data[i] = 0;
 	  }
 	}
 
 	~Matrix() {
-	  for (size_t i = 0; i < blockCount * blockCount; ++i) {
-		delete blocks[i];
-	  }
-
-	  delete[] blocks;
+	  delete[] data;
 	}
 
-	Submatrix* getBlock(size_t rowIndex, size_t columnIndex) {
+	/*!
+	 * \brief Начало блока (blockSize * blockSize элементов подряд). Индексы проверяются только в отладочной сборке.
+	 */
+	ElementType* getBlock(size_t rowIndex, size_t columnIndex) {
+#ifndef NDEBUG
 	  if (rowIndex >= blockCount || columnIndex >= blockCount) {
 		throw std::exception("Invalid indexes.");
 	  }
-	  return *(blocks + rowIndex * blockCount + columnIndex);
+#endif
+	  return data + (rowIndex * blockCount + columnIndex) * blockSize * blockSize;
 	}
 
-	ElementType& getValue(size_t columnIndex, size_t rowIndex) {
-	  return getBlock(columnIndex / blockSize, rowIndex / blockSize)
-		->getValue(columnIndex % blockSize, rowIndex % blockSize);
+	/*!
+	 * \brief Часть строки rowIndex матрицы, лежащая в блоке с горизонтальным номером blockIndex (blockSize элементов подряд).
+	 */
+	ElementType* getRowSegment(size_t rowIndex, size_t blockIndex) {
+	  return getBlock(blockIndex, rowIndex / blockSize) + (rowIndex % blockSize) * blockSize;
 	}
-  };
-
-  /*!
-   * \brief Загрузить матрицу из файла.
-   */
-  void readMatrixFromFile(Matrix& matrix, const std::string& path) {
-	std::ifstream file(path);
-
-	if (file.is_open()) {
-	  size_t matrixSize = matrix.blockCount * matrix.blockSize;
 
-	  for (size_t y = 0; y < matrixSize; ++y) {
-		for (size_t x = 0; x < matrixSize; ++x) {
-		  ElementType value;
+	ElementType& getValue(size_t columnIndex, size_t rowIndex) {
+	  return getRowSegment(rowIndex, columnIndex / blockSize)[columnIndex % blockSize];
+	}
 
-		  file >> value;
+	/*!
+	 * \brief Заголовок двоичного файла с той же разбивкой на блоки (такой файл загружается одним копированием).
+	 */
+	matrix_file::MatrixFileHeader getFileHeader() const {
+	  const size_t matrixSize = blockCount * blockSize;
 
-		  matrix.getValue(x, y) = value;
-		}
-	  }
+	  return matrix_file::MatrixFileHeader(matrix_file::ElementKindOf<ElementType>::value, matrixSize, matrixSize,
+		blockCount, blockCount, blockSize, blockSize);
 	}
-
-	file.close();
-  }
+  };
 
   /*!
-   * \brief Сохранить матрицу в файл.
+   * \brief Загрузить матрицу из двоичного файла (см. matrix-file.h).
+   *
+   * Файл с той же разбивкой на блоки копируется одним блоком, с другой разбивкой - частями строк.
+   * Возвращает false, если файл не открывается или не подходит матрице.
    */
-  void saveMatrixToFile(Matrix& matrix, const std::string& path) {
-	std::ofstream file(path);
+  bool readMatrixFromFile(Matrix& matrix, const std::string& path) {
+	matrix_file::MappedMatrixFile file;
+	const size_t matrixSize = matrix.blockCount * matrix.blockSize;
 
-	if (file.is_open()) {
-	  size_t matrixSize = matrix.blockCount * matrix.blockSize;
+	if (!file.open(path) || file.getData<ElementType>() == nullptr || file.header.width != matrixSize
+	  || file.header.height != matrixSize) {
+	  return false;
+	}
 
+	if (file.header.hasSameLayout(matrix.getFileHeader())) {
+	  std::memcpy(matrix.data, file.getData<ElementType>(), file.header.getElementCount() * sizeof(ElementType));
+	}
+	else {
 	  for (size_t y = 0; y < matrixSize; ++y) {
-		for (size_t x = 0; x < matrixSize; ++x) {
-		  file << matrix.getValue(x, y) << " ";
+		for (size_t block = 0; block < matrix.blockCount; ++block) {
+		  file.readRowSegment(y, block * matrix.blockSize, matrix.blockSize, matrix.getRowSegment(y, block));
 		}
-		file << "\n";
 	  }
 	}
 
-	file.close();
+	return true;
   }
 
   /*!
-   * \brief Сгенерировать случайную матрицу (элементы от 0 до 99).
+   * \brief Сохранить матрицу в двоичный файл вместе с разбивкой на блоки.
    */
-  void generateMatrix(Matrix& matrix) {
-	srand(time(nullptr));
-	size_t matrixSize = matrix.blockCount * matrix.blockSize;
-
-	for (size_t y = 0; y < matrixSize; ++y) {
-	  for (size_t x = 0; x < matrixSize; ++x) {
-		matrix.getValue(x, y) = rand() % 100;
-	  }
-	}
+  bool saveMatrixToFile(Matrix& matrix, const std::string& path) {
+	return matrix_file::writeMatrixFile(path, matrix.getFileHeader(), matrix.data);
   }
 }
 
@@ -457,6 +1143,8 @@ int main()
   const size_t matrixSize = 2048;
   const size_t blockCount = 8;
   const size_t blockSize = matrixSize / blockCount;
+  // Зерно генератора матриц: A генерируется с зерном matrixSeed, B - с зерном matrixSeed + 1
+  const uint64_t matrixSeed = 2024;
 
   if (blockCount * blockCount != THREADS || matrixSize % blockCount != 0)
   {
@@ -471,91 +1159,71 @@ int main()
 	const auto threadId = omp_get_thread_num();
 	const auto coords = grid.getCoordsByThreadId(threadId);
 
-	Submatrix* blockA = nullptr;
-	Submatrix* blockB = nullptr;
-	Submatrix* blockC = nullptr;
+	Submatrix* blockA = new Submatrix(blockSize);
+	Submatrix* blockB = new Submatrix(blockSize);
+	Submatrix* blockC = new Submatrix(blockSize);
 	double startTime;
 
-	if (threadId == 0) {
-	  Matrix matrixA(blockCount, blockSize);
-	  Matrix matrixB(blockCount, blockSize);
+	// Каждый поток сам генерирует свои блоки A (x, y) и B (x, y): элементы зависят только от зерна и положения
+	// в матрице, поэтому матрицы не зависят от числа потоков и не раздаются корнем
+	matrix_random::generateMatrixPart(matrixSeed, matrixSize, matrixSize, coords.second * blockSize, coords.first * blockSize,
+	  blockSize, blockSize, blockA->data, blockSize);
+	matrix_random::generateMatrixPart(matrixSeed + 1, matrixSize, matrixSize, coords.second * blockSize, coords.first * blockSize,
+	  blockSize, blockSize, blockB->data, blockSize);
 
-	  generateMatrix(matrixA);
-	  generateMatrix(matrixB);
+	#pragma omp barrier
 
+	if (threadId == 0) {
 	  startTime = omp_get_wtime();
-
-	  for (size_t y = 0; y < blockCount; ++y)
-	  {
-		for (size_t x = 0; x < blockCount; ++x)
-		{
-		  if (x != 0 || y != 0) {
-			int destId = grid.getThreadIdByCoords(x, y);
-			sendData(matrixA.getBlock(x, y)->data, blockSize * blockSize, sizeof(ElementType), destId, 1);
-			sendData(matrixB.getBlock(x, y)->data, blockSize * blockSize, sizeof(ElementType), destId, 1);
-		  }
-		}
-	  }
-
-	  blockA = new Submatrix(blockSize);
-	  blockB = new Submatrix(blockSize);
-	  blockC = new Submatrix(blockSize);
-
-	  memcpy(blockA->data, matrixA.getBlock(0, 0)->data, blockSize * blockSize * sizeof(ElementType));
-	  memcpy(blockB->data, matrixB.getBlock(0, 0)->data, blockSize * blockSize * sizeof(ElementType));
 	}
-	else
-	{
-	  blockA = new Submatrix(blockSize);
-	  blockB = new Submatrix(blockSize);
-	  blockC = new Submatrix(blockSize);
 
-	  recieveData(blockA->data, blockSize * blockSize, sizeof(ElementType), 0, 1);
-	  recieveData(blockB->data, blockSize * blockSize, sizeof(ElementType), 0, 1);
-	}
+	// Буферы приема при сдвиге блоков: после получения данных меняются местами с буферами блоков
+	ElementType* shiftBufferA = new ElementType[blockSize * blockSize];
+	ElementType* shiftBufferB = new ElementType[blockSize * blockSize];
 
 	{
 	  int source, dest;
 	  grid.shift(0, -coords.second, source, dest);
-	  sendData(blockA->data, blockSize * blockSize, sizeof(int), dest, 2);
-	  recieveData(blockA->data, blockSize * blockSize, sizeof(int), source, 2);
+	  sendRecieveData(blockA->data, shiftBufferA, blockSize * blockSize, sizeof(ElementType), dest, source, 2);
+	  std::swap(blockA->data, shiftBufferA);
 	}
 
 	{
 	  int source, dest;
 	  grid.shift(1, -coords.first, source, dest);
-	  sendData(blockB->data, blockSize * blockSize, sizeof(int), dest, 3);
-	  recieveData(blockB->data, blockSize * blockSize, sizeof(int), source, 3);
+	  sendRecieveData(blockB->data, shiftBufferB, blockSize * blockSize, sizeof(ElementType), dest, source, 3);
+	  std::swap(blockB->data, shiftBufferB);
 	}
 
 	for (size_t q = 0; q < blockCount; ++q)
 	{
-	  for (size_t y = 0; y < blockSize; ++y)
-	  {
-		for (size_t x = 0; x < blockSize; ++x)
-		{
-		  ElementType value = 0;
-
-		  for (size_t i = 0; i < blockSize; ++i) {
-			value += blockA->getValue(i, y) * blockB->getValue(x, i);
-		  }
-
-		  blockC->getValue(x, y) += value;
-		}
-	  }
+	  // Сдвиг блоков для следующей итерации выполняется во время умножения текущих блоков
+	  const bool shiftBlocks = q + 1 < blockCount;
+	  Request requests[4];
 
+	  if (shiftBlocks)
 	  {
 		int source, dest;
 		grid.shift(0, -1, source, dest);
-		sendData(blockA->data, blockSize * blockSize, sizeof(ElementType), dest, 4);
-		recieveData(blockA->data, blockSize * blockSize, sizeof(ElementType), source, 4);
+		irecvData(shiftBufferA, blockSize * blockSize, sizeof(ElementType), source, 4, requests[0]);
+		isendData(blockA->data, blockSize * blockSize, sizeof(ElementType), dest, 4, requests[1]);
+
+		grid.shift(1, -1, source, dest);
+		irecvData(shiftBufferB, blockSize * blockSize, sizeof(ElementType), source, 4, requests[2]);
+		isendData(blockB->data, blockSize * blockSize, sizeof(ElementType), dest, 4, requests[3]);
 	  }
 
+	  matrix_kernels::multiplyAdd(blockA->data, blockB->data, blockC->data, blockSize, [&requests]()
 	  {
-		int source, dest;
-		grid.shift(1, -1, source, dest);
-		sendData(blockB->data, blockSize * blockSize, sizeof(ElementType), dest, 4);
-		recieveData(blockB->data, blockSize * blockSize, sizeof(ElementType), source, 4);
+		testAll(requests, 4);
+	  });
+
+	  waitAll(requests, 4);
+
+	  if (shiftBlocks)
+	  {
+		std::swap(blockA->data, shiftBufferA);
+		std::swap(blockB->data, shiftBufferB);
 	  }
 	}
 
@@ -567,14 +1235,8 @@ int main()
 	}
 
 	{
-	  ElementType* recvBuffer = nullptr;
-
-	  if (threadId == 0)
-	  {
-		recvBuffer = new ElementType[matrixSize * matrixSize];
-	  }
-
-	  gatherData(blockC->data, recvBuffer, blockSize * blockSize, sizeof(ElementType), 0);
+	  // Каждый поток записывает свой блок C сразу в соответствующий блок итоговой матрицы
+	  std::array<void*, THREADS> destinations{};
 
 	  if (threadId == 0)
 	  {
@@ -582,14 +1244,12 @@ int main()
 		{
 		  for (size_t y = 0; y < blockCount; ++y)
 		  {
-			memcpy(matrixC->getBlock(x, y)->data,
-			  recvBuffer + x * blockSize * blockSize * blockCount + y * blockSize * blockSize,
-			  blockSize * blockSize * sizeof(ElementType));
+			destinations[grid.getThreadIdByCoords(x, y)] = matrixC->getBlock(x, y);
 		  }
 		}
-
-		delete[] recvBuffer;
 	  }
+
+	  gatherDataDirect(blockC->data, blockSize * blockSize, sizeof(ElementType), destinations.data(), 0);
 	}
 
 	if (threadId == 0)
@@ -613,8 +1273,12 @@ int main()
 	delete blockA;
 	delete blockB;
 	delete blockC;
+	delete[] shiftBufferA;
+	delete[] shiftBufferB;
 	delete matrixC;
   }
 
+  printMessagePoolStatistics();
+
   return 0;
 }